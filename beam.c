@@ -0,0 +1,235 @@
+#include "beam.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pico/time.h"
+
+typedef struct {
+    Hypothesis hyp;
+    KVSeq kv;
+    int pos;                    /* next position to run */
+} Beam;
+
+/* A possible continuation of beam `parent` */
+typedef struct {
+    int parent;
+    int token;
+    float logprob;              /* total, parent included */
+} Candidate;
+
+static Beam beams[MAX_BEAMS];
+static Beam next_beams[MAX_BEAMS];
+static int prompt_tokens[MAX_SEQ_LEN];
+
+/* Insert c into the k-best list (descending logprob) of length *n */
+static void keep_best(Candidate *list, int *n, int k, Candidate c) {
+    if (*n == k && c.logprob <= list[k - 1].logprob) return;
+    int i = *n < k ? (*n)++ : k - 1;
+    while (i > 0 && list[i - 1].logprob < c.logprob) {
+        list[i] = list[i - 1];
+        i--;
+    }
+    list[i] = c;
+}
+
+/* Add beam b's top-k next tokens, by log-softmax of logits, to the pool */
+static void expand(const float *logits, int vocab, int b, float base,
+                   int k, Candidate *pool, int *n_pool) {
+    float max_val = logits[0];
+    for (int i = 1; i < vocab; i++) {
+        if (logits[i] > max_val) max_val = logits[i];
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < vocab; i++) sum += expf(logits[i] - max_val);
+    float log_z = max_val + logf(sum);
+
+    Candidate top[MAX_BEAMS];
+    int n_top = 0;
+    for (int i = 0; i < vocab; i++) {
+        Candidate c = { b, i, logits[i] };
+        keep_best(top, &n_top, k, c);
+    }
+    for (int i = 0; i < n_top; i++) {
+        top[i].logprob = base + top[i].logprob - log_z;
+        keep_best(pool, n_pool, MAX_BEAMS * MAX_BEAMS, top[i]);
+    }
+}
+
+static float mean_logprob(const Hypothesis *h) {
+    return h->n_tokens ? h->logprob / h->n_tokens : h->logprob;
+}
+
+/* Keep the width best finished hypotheses in out, best first */
+static void add_result(Hypothesis *out, int *n_out, int width,
+                       const Hypothesis *h) {
+    float score = mean_logprob(h);
+    if (*n_out == width && score <= mean_logprob(&out[width - 1])) return;
+    int i = *n_out < width ? (*n_out)++ : width - 1;
+    while (i > 0 && mean_logprob(&out[i - 1]) < score) {
+        out[i] = out[i - 1];
+        i--;
+    }
+    out[i] = *h;
+}
+
+int beam_search(Transformer *t, Tokenizer *tokenizer, const char *prompt,
+                int width, int steps, Hypothesis *out, BeamStats *stats) {
+    Config *p = &t->config;
+    if (width < 1) width = 1;
+    if (width > MAX_BEAMS) width = MAX_BEAMS;
+    if (steps == 0 || steps > p->seq_len) steps = p->seq_len;
+    if (strlen(prompt) + 3 > MAX_SEQ_LEN) {
+        printf("Beam: prompt longer than %d bytes\n", MAX_SEQ_LEN - 3);
+        return -1;
+    }
+    int n_prompt = 0;
+    encode(tokenizer, (char *)prompt, 1, 0, prompt_tokens, &n_prompt);
+    if (n_prompt < 1 || n_prompt >= steps) return -1;
+
+    uint64_t t0 = time_us_64();
+    BeamStats st;
+    memset(&st, 0, sizeof(st));
+    int pages = kv_pages_init(t);
+
+    /* Worst case every beam diverges right after the prompt: the prompt's
+       full blocks are shared and each beam owns the rest of its blocks */
+    int shared = n_prompt / KV_BLOCK_SIZE;
+    int per_beam = shared + (pages - shared) / width;
+    if (steps > per_beam * KV_BLOCK_SIZE) {
+        steps = per_beam * KV_BLOCK_SIZE;
+        if (n_prompt >= steps) {
+            printf("Beam: %d pages can't hold %d beams past the prompt\n",
+                   pages, width);
+            return -1;
+        }
+    }
+    st.step_limit = steps;
+
+    /* Prefill the prompt once into the first beam; the rest fork it */
+    Beam *root = &beams[0];
+    memset(&root->hyp, 0, sizeof(root->hyp));
+    kv_seq_init(&root->kv);
+    t->kv_seq = &root->kv;
+    float *logits = NULL;
+    for (int pos = 0; pos < n_prompt; pos++) {
+        logits = forward(t, prompt_tokens[pos], pos);
+        if (logits == NULL) {
+            printf("Beam: prompt doesn't fit the KV pages\n");
+            kv_seq_free(&root->kv);
+            t->kv_seq = NULL;
+            return -1;
+        }
+    }
+    root->pos = n_prompt;
+    st.positions = n_prompt;
+
+    Candidate pool[MAX_BEAMS * MAX_BEAMS];
+    int n_pool = 0;
+    expand(logits, p->vocab_size, 0, 0.0f, width, pool, &n_pool);
+    int n_live = 1, n_out = 0;
+
+    /* Until width hypotheses have finished (early stopping) */
+    while (n_pool > 0 && n_out < width) {
+        /* The best candidates either finish or become the next beams,
+           sharing their parent's pages */
+        int n_next = 0;
+        for (int i = 0; i < n_pool && n_next < width; i++) {
+            Beam *parent = &beams[pool[i].parent];
+            Beam *child = &next_beams[n_next];
+            child->hyp.n_tokens = parent->hyp.n_tokens;
+            memcpy(child->hyp.tokens, parent->hyp.tokens,
+                   parent->hyp.n_tokens * sizeof(int));
+            child->hyp.tokens[child->hyp.n_tokens++] = pool[i].token;
+            child->hyp.logprob = pool[i].logprob;
+            child->hyp.finished = pool[i].token == 1;
+            child->pos = parent->pos;
+
+            if (child->hyp.finished || child->pos >= steps) {
+                add_result(out, &n_out, width, &child->hyp);
+                continue;
+            }
+            kv_seq_init(&child->kv);
+            kv_seq_fork(&child->kv, &parent->kv);
+            n_next++;
+        }
+        for (int b = 0; b < n_live; b++) kv_seq_free(&beams[b].kv);
+        memcpy(beams, next_beams, n_next * sizeof(Beam));
+        n_live = n_next;
+
+        if (n_out >= width) break;
+
+        /* Run each live beam one position and pool its expansions */
+        n_pool = 0;
+        for (int b = 0; b < n_live; b++) {
+            Beam *beam = &beams[b];
+            t->kv_seq = &beam->kv;
+            int token = beam->hyp.tokens[beam->hyp.n_tokens - 1];
+            logits = forward(t, token, beam->pos);
+            st.forwards++;
+            if (logits == NULL) {
+                printf("Beam: out of KV pages at pos %d\n", beam->pos);
+                st.out_of_pages = 1;
+                n_pool = 0;
+                break;
+            }
+            beam->pos++;
+            if (beam->pos > st.positions) st.positions = beam->pos;
+            expand(logits, p->vocab_size, b, beam->hyp.logprob, width,
+                   pool, &n_pool);
+        }
+        st.steps++;
+        if (n_pool == 0) break;
+    }
+
+    /* Whatever is still running counts at the limit (or where the pages
+       ran out, flagged in stats) */
+    for (int b = 0; b < n_live; b++) {
+        add_result(out, &n_out, width, &beams[b].hyp);
+        kv_seq_free(&beams[b].kv);
+    }
+    t->kv_seq = NULL;
+
+    st.pages = kv_pages_stats();
+    st.elapsed_us = time_us_64() - t0;
+    if (stats) *stats = st;
+    return n_out;
+}
+
+void generate_beam(Transformer *t, Tokenizer *tokenizer, char *prompt,
+                   int width, int steps) {
+    static Hypothesis results[MAX_BEAMS];
+    BeamStats st;
+    int n = beam_search(t, tokenizer, prompt, width, steps, results, &st);
+    if (n < 0) {
+        printf("Beam: search failed\n");
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        Hypothesis *h = &results[i];
+        printf("\n[%d] logprob %.3f, %.3f/token, %d tokens%s\n%s", i,
+               (double)h->logprob, (double)mean_logprob(h), h->n_tokens,
+               h->finished ? "" : st.out_of_pages ? " (out of pages)" :
+               " (limit)", prompt);
+        int prev = 1;
+        for (int k = 0; k < h->n_tokens && h->tokens[k] != 1; k++) {
+            safe_printf(decode(tokenizer, prev, h->tokens[k]));
+            prev = h->tokens[k];
+        }
+        printf("\n");
+    }
+
+    int blocks = (st.positions + KV_BLOCK_SIZE - 1) / KV_BLOCK_SIZE;
+    int unshared = width * blocks;
+    printf("\nBeam: width %d, %d steps (limit pos %d), %d forwards in "
+           "%.1f ms\n", width, st.steps, st.step_limit, st.forwards,
+           st.elapsed_us / 1000.0);
+    if (st.out_of_pages) {
+        printf("Beam: stopped early, out of KV pages\n");
+    }
+    printf("Beam: KV pages peak %d of %d (%d positions each), %d copied on "
+           "write; %d unshared caches to pos %d would need %d\n",
+           st.pages.peak, st.pages.pages, KV_BLOCK_SIZE, st.pages.copies,
+           width, st.positions, unshared);
+    fflush(stdout);
+}
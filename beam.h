@@ -0,0 +1,67 @@
+#ifndef BEAM_H
+#define BEAM_H
+
+#include "transformer.h"
+#include "tokenizer.h"
+#include "kvpage.h"
+
+/*
+ * Beam search / n-best generation on the paged KV cache (kvpage.h).
+ * Each step runs every live beam one position, expands it with its
+ * top-width next tokens and keeps the width best continuations by total
+ * log-probability. Children fork their parent's KV pages, so beams share
+ * the prompt and any common prefix and only copy the block they diverge
+ * in. A beam that emits BOS is finished, and the search stops once width
+ * hypotheses have. Finished hypotheses are ranked by mean log-probability
+ * per token, so short endings aren't favoured.
+ *
+ * Capacity: the page pool is the contiguous cache's memory, one seq_len
+ * worth of KV (seq_len / KV_BLOCK_SIZE pages, capped at MAX_KV_PAGES).
+ * To be sure never to run out, beam_search() caps steps so that every
+ * beam could own its blocks past the prompt: with P pages and S full
+ * prompt blocks shared, each beam gets S + (P - S) / width blocks. For
+ * stories260K (16 pages of 16 positions) and width 4 that is 64
+ * positions after a short prompt, against 256 for width 1.
+ */
+#ifndef MAX_BEAMS
+#define MAX_BEAMS 4
+#endif
+
+typedef struct {
+    int tokens[MAX_SEQ_LEN];    /* generated tokens, prompt excluded */
+    int n_tokens;
+    float logprob;              /* sum over tokens */
+    int finished;               /* ended with BOS rather than the limit */
+} Hypothesis;
+
+typedef struct {
+    int steps;                  /* positions run per beam */
+    int step_limit;             /* steps after capping to the page pool */
+    int out_of_pages;           /* the pool ran dry and cut the search
+                                   short; unfinished hypotheses stop there */
+    int positions;              /* deepest position reached */
+    int forwards;               /* forward() calls across beams */
+    KVPageStats pages;
+    uint64_t elapsed_us;
+} BeamStats;
+
+/**
+ * Search from prompt with up to width beams (at most MAX_BEAMS) until
+ * width hypotheses finish or pos reaches steps (0 = seq_len; either way
+ * capped to what the page pool holds, see above). Fills out with up to
+ * width hypotheses, best first, and returns how many; negative on error.
+ * stats->out_of_pages tells a search the pool cut short apart from one
+ * that reached the limit. Takes over the KV cache memory (see
+ * kv_pages_init()).
+ */
+int beam_search(Transformer *t, Tokenizer *tokenizer, const char *prompt,
+                int width, int steps, Hypothesis *out, BeamStats *stats);
+
+/**
+ * Run beam_search() and print the n-best list over USB serial with
+ * scores, page use and timing.
+ */
+void generate_beam(Transformer *t, Tokenizer *tokenizer, char *prompt,
+                   int width, int steps);
+
+#endif /* BEAM_H */
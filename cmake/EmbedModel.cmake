@@ -0,0 +1,233 @@
+# EmbedModel.cmake - embed a model and its tokenizer in the firmware image
+#
+#   pico_llama_embed_model(<target>
+#       MODEL <file> TOKENIZER <file>
+#       [NAME <name>] [ALIGN <bytes>] [MAX_SEQ_LEN <n>]
+#       [PSRAM_BUDGET <bytes>] [SRAM_BUDGET <bytes>] [FLASH_BUDGET <bytes>]
+#       [PIN_BUDGET <bytes>] [FLASH_SIZE <bytes>]
+#       [SESSION_FLASH_SIZE <bytes>])
+#
+# Both files are pulled in with .incbin into the .rodata.pico_llama_model
+# section (flash), each starting on an ALIGN boundary (default 64, the
+# PSRAM region alignment). A generated model_data.h declares the symbols
+# and gives their sizes and the model's Config as constants. The target's
+# MAX_* buffer sizes (model_limits.h) are set from that Config, with
+# MAX_SEQ_LEN capped at MAX_SEQ_LEN (default 256), so the static buffers
+# fit the model exactly. SRAM_PIN_BUDGET (placement.h) gets whatever the
+# SRAM budget leaves after those static buffers, rounded down to 1 KB and
+# capped at the model size, unless PIN_BUDGET is given. Configuring fails
+# if the model doesn't fit the PSRAM, SRAM or flash budget.
+#
+# The session region (flash_store.h) takes the top SESSION_FLASH_SIZE
+# bytes (default 512 KB) of the FLASH_SIZE-byte flash (default 16 MB), and
+# the target is built with that size so the two agree. The flash budget
+# defaults to what is left below it less 1 MB for code, and for SDK
+# builds the link fails if the image runs into the region.
+
+# Little-endian int32 at offset in file, into out
+function(_pico_llama_read_i32 file offset out)
+    file(READ ${file} hex OFFSET ${offset} LIMIT 4 HEX)
+    string(SUBSTRING ${hex} 0 2 b0)
+    string(SUBSTRING ${hex} 2 2 b1)
+    string(SUBSTRING ${hex} 4 2 b2)
+    string(SUBSTRING ${hex} 6 2 b3)
+    math(EXPR value "0x${b3}${b2}${b1}${b0}")
+    if(value GREATER_EQUAL 2147483648)
+        math(EXPR value "${value} - 4294967296")
+    endif()
+    set(${out} ${value} PARENT_SCOPE)
+endfunction()
+
+function(pico_llama_embed_model target)
+    cmake_parse_arguments(ARG ""
+        "MODEL;TOKENIZER;NAME;ALIGN;MAX_SEQ_LEN;PSRAM_BUDGET;SRAM_BUDGET;FLASH_BUDGET;PIN_BUDGET;FLASH_SIZE;SESSION_FLASH_SIZE"
+        "" ${ARGN})
+    foreach(file MODEL TOKENIZER)
+        if(NOT ARG_${file} OR NOT EXISTS ${ARG_${file}})
+            message(FATAL_ERROR "pico_llama_embed_model: ${file} "
+                                "'${ARG_${file}}' not found")
+        endif()
+        get_filename_component(ARG_${file} ${ARG_${file}} ABSOLUTE)
+    endforeach()
+    if(NOT ARG_NAME)
+        get_filename_component(ARG_NAME ${ARG_MODEL} NAME_WE)
+    endif()
+    if(NOT ARG_ALIGN)
+        set(ARG_ALIGN 64)
+    endif()
+    if(NOT ARG_MAX_SEQ_LEN)
+        set(ARG_MAX_SEQ_LEN 256)
+    endif()
+    if(NOT ARG_PSRAM_BUDGET)
+        set(ARG_PSRAM_BUDGET 8388608)       # 8 MB APS6404L
+    endif()
+    if(NOT ARG_SRAM_BUDGET)
+        set(ARG_SRAM_BUDGET 466944)         # 520 KB less stack and SDK
+    endif()
+    if(NOT ARG_FLASH_SIZE)
+        set(ARG_FLASH_SIZE 16777216)        # 16 MB on the Pico Plus 2W
+    endif()
+    if(NOT DEFINED ARG_SESSION_FLASH_SIZE)
+        set(ARG_SESSION_FLASH_SIZE 524288)  # flash_store.h default
+    endif()
+    math(EXPR session_offset "${ARG_FLASH_SIZE} - ${ARG_SESSION_FLASH_SIZE}")
+    if(NOT ARG_FLASH_BUDGET)
+        # Below the session region, less 1 MB for code
+        math(EXPR ARG_FLASH_BUDGET "${session_offset} - 1048576")
+    endif()
+
+    file(SIZE ${ARG_MODEL} model_bytes)
+    file(SIZE ${ARG_TOKENIZER} tokenizer_bytes)
+
+    # Config: right at the start of legacy llama2.c files, after the magic
+    # and version in PLMA files (transformer.h)
+    _pico_llama_read_i32(${ARG_MODEL} 0 magic)
+    set(config_offset 0)
+    if(magic EQUAL 1095584848)              # "PLMA"
+        set(config_offset 8)
+    endif()
+    set(i 0)
+    foreach(field DIM HIDDEN_DIM N_LAYERS N_HEADS N_KV_HEADS VOCAB_SIZE SEQ_LEN)
+        math(EXPR offset "${config_offset} + ${i} * 4")
+        _pico_llama_read_i32(${ARG_MODEL} ${offset} ${field})
+        math(EXPR i "${i} + 1")
+    endforeach()
+    if(VOCAB_SIZE LESS 0)                   # negative: unshared classifier
+        math(EXPR VOCAB_SIZE "-${VOCAB_SIZE}")
+    endif()
+    if(DIM LESS_EQUAL 0 OR N_HEADS LESS_EQUAL 0 OR N_KV_HEADS LESS_EQUAL 0
+       OR N_LAYERS LESS_EQUAL 0 OR SEQ_LEN LESS_EQUAL 0)
+        message(FATAL_ERROR "${ARG_MODEL}: not a llama2.c or PLMA model")
+    endif()
+    set(seq ${SEQ_LEN})
+    if(seq GREATER ARG_MAX_SEQ_LEN)
+        set(seq ${ARG_MAX_SEQ_LEN})
+    endif()
+    math(EXPR head_size "${DIM} / ${N_HEADS}")
+    math(EXPR kv_dim "${DIM} * ${N_KV_HEADS} / ${N_HEADS}")
+
+    # Static SRAM the model sizes: RunState, KV cache, the conversion
+    # probe and forward_batch() rows (MAX_BATCH 8) in transformer.c, RoPE
+    # tables, tokenizer and sampler tables. The pin pool gets the rest.
+    set(row ${HIDDEN_DIM})
+    if(DIM GREATER row)
+        set(row ${DIM})
+    endif()
+    math(EXPR sram_bytes "4 * (5 * ${DIM} + 2 * ${HIDDEN_DIM}
+        + ${N_HEADS} * ${seq} + 2 * ${VOCAB_SIZE}
+        + 2 * ${N_LAYERS} * ${seq} * ${kv_dim} + ${seq}
+        + ${seq} * ${head_size}
+        + 8 * (4 * ${DIM} + 2 * ${HIDDEN_DIM}) + ${row})
+        + 28 * ${VOCAB_SIZE}")
+    if(DEFINED ARG_PIN_BUDGET)
+        set(pin_bytes ${ARG_PIN_BUDGET})
+    elseif(sram_bytes LESS ARG_SRAM_BUDGET)
+        math(EXPR pin_bytes "(${ARG_SRAM_BUDGET} - ${sram_bytes}) / 1024 * 1024")
+        if(pin_bytes GREATER model_bytes)
+            set(pin_bytes ${model_bytes})
+        endif()
+    else()
+        set(pin_bytes 0)
+    endif()
+    math(EXPR flash_bytes "${model_bytes} + ${tokenizer_bytes}")
+
+    message(STATUS "Model ${ARG_NAME}: ${model_bytes} bytes, dim=${DIM} "
+        "hidden=${HIDDEN_DIM} layers=${N_LAYERS} heads=${N_HEADS} "
+        "kv_heads=${N_KV_HEADS} vocab=${VOCAB_SIZE} seq_len=${SEQ_LEN} "
+        "(${seq} cached), ~${sram_bytes} bytes static SRAM, "
+        "${pin_bytes} byte pin pool")
+    if(model_bytes GREATER ARG_PSRAM_BUDGET)
+        message(FATAL_ERROR "Model ${ARG_NAME} is ${model_bytes} bytes, "
+            "over the PSRAM budget of ${ARG_PSRAM_BUDGET}")
+    endif()
+    math(EXPR sram_total "${sram_bytes} + ${pin_bytes}")
+    if(sram_total GREATER ARG_SRAM_BUDGET)
+        message(FATAL_ERROR "Model ${ARG_NAME} needs ~${sram_total} bytes "
+            "of static SRAM with the pin pool, over the budget of "
+            "${ARG_SRAM_BUDGET}; lower MAX_SEQ_LEN or PIN_BUDGET or use a "
+            "smaller model")
+    endif()
+    if(flash_bytes GREATER ARG_FLASH_BUDGET)
+        message(FATAL_ERROR "Model and tokenizer are ${flash_bytes} bytes, "
+            "over the flash budget of ${ARG_FLASH_BUDGET} (flash below the "
+            "${ARG_SESSION_FLASH_SIZE} byte session region, less code)")
+    endif()
+
+    set(gen_dir ${CMAKE_CURRENT_BINARY_DIR}/model_data)
+    file(MAKE_DIRECTORY ${gen_dir})
+    file(WRITE ${gen_dir}/model_data.S
+"/* Generated by cmake/EmbedModel.cmake from ${ARG_MODEL} - do not edit */
+    .section .rodata.pico_llama_model, \"a\"
+    .balign ${ARG_ALIGN}
+    .global model_data
+model_data:
+    .incbin \"${ARG_MODEL}\"
+    .balign ${ARG_ALIGN}
+    .global tokenizer_data
+tokenizer_data:
+    .incbin \"${ARG_TOKENIZER}\"
+    .global pico_llama_model_end
+pico_llama_model_end:
+#if defined(__linux__) && defined(__ELF__)
+    .section .note.GNU-stack, \"\", %progbits
+#endif
+")
+    file(WRITE ${gen_dir}/model_data.h
+"/* Generated by cmake/EmbedModel.cmake from ${ARG_MODEL} - do not edit */
+#ifndef MODEL_DATA_H
+#define MODEL_DATA_H
+
+#define MODEL_DATA_NAME      \"${ARG_NAME}\"
+#define MODEL_DATA_BYTES     ${model_bytes}u
+#define TOKENIZER_DATA_BYTES ${tokenizer_bytes}u
+#define MODEL_DATA_ALIGN     ${ARG_ALIGN}
+
+/* Config as stored in the file (vocab size made positive) */
+#define MODEL_CONFIG_DIM        ${DIM}
+#define MODEL_CONFIG_HIDDEN_DIM ${HIDDEN_DIM}
+#define MODEL_CONFIG_N_LAYERS   ${N_LAYERS}
+#define MODEL_CONFIG_N_HEADS    ${N_HEADS}
+#define MODEL_CONFIG_N_KV_HEADS ${N_KV_HEADS}
+#define MODEL_CONFIG_VOCAB_SIZE ${VOCAB_SIZE}
+#define MODEL_CONFIG_SEQ_LEN    ${SEQ_LEN}
+
+/* In flash, section .rodata.pico_llama_model, MODEL_DATA_ALIGN aligned */
+extern const unsigned char model_data[];
+extern const unsigned char tokenizer_data[];
+
+#endif /* MODEL_DATA_H */
+")
+
+    target_sources(${target} PRIVATE ${gen_dir}/model_data.S)
+    set_source_files_properties(${gen_dir}/model_data.S PROPERTIES
+        OBJECT_DEPENDS "${ARG_MODEL};${ARG_TOKENIZER}")
+    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS
+        ${ARG_MODEL} ${ARG_TOKENIZER})
+    target_include_directories(${target} PRIVATE ${gen_dir})
+
+    # The budget above is an estimate of the code size; the link checks
+    # the real image against the session region (XIP flash at 0x10000000).
+    # An implicit linker script, so it adds to the SDK's memory map.
+    if(DEFINED PICO_PLATFORM)
+        math(EXPR store_addr "0x10000000 + ${session_offset}"
+             OUTPUT_FORMAT HEXADECIMAL)
+        file(WRITE ${gen_dir}/flash_check.ld
+"/* Generated by cmake/EmbedModel.cmake - do not edit */
+ASSERT(pico_llama_model_end <= ${store_addr},
+       \"model and tokenizer overlap the session flash region\")
+ASSERT(__flash_binary_end <= ${store_addr},
+       \"firmware image overlaps the session flash region\")
+")
+        target_link_options(${target} PRIVATE ${gen_dir}/flash_check.ld)
+        set_property(TARGET ${target} APPEND PROPERTY LINK_DEPENDS
+            ${gen_dir}/flash_check.ld)
+    endif()
+
+    target_compile_definitions(${target} PRIVATE
+        PICO_LLAMA_FLASH_SIZE=${ARG_FLASH_SIZE}
+        SESSION_FLASH_SIZE=${ARG_SESSION_FLASH_SIZE}
+        MAX_DIM=${DIM} MAX_HIDDEN_DIM=${HIDDEN_DIM} MAX_N_LAYERS=${N_LAYERS}
+        MAX_N_HEADS=${N_HEADS} MAX_N_KV_HEADS=${N_KV_HEADS}
+        MAX_VOCAB_SIZE=${VOCAB_SIZE} MAX_SEQ_LEN=${seq}
+        SRAM_PIN_BUDGET=${pin_bytes})
+endfunction()
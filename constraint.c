@@ -0,0 +1,169 @@
+#include "constraint.h"
+#include <stdio.h>
+#include <string.h>
+
+/* ---- DFA construction ---- */
+
+static void reset(Constraint *c) {
+    memset(c, 0, sizeof(*c));
+    c->n_states = 1;
+}
+
+static int add_state(Constraint *c) {
+    if (c->n_states == MAX_CONSTRAINT_STATES) return -1;
+    return c->n_states++;
+}
+
+/* Edge from --byte--> to, or the existing target if there is one */
+static int add_edge(Constraint *c, int from, uint8_t byte, int to) {
+    for (int i = 0; i < c->n_edges; i++) {
+        if (c->edges[i].from == from && c->edges[i].byte == byte) {
+            return c->edges[i].to;
+        }
+    }
+    if (c->n_edges == MAX_CONSTRAINT_EDGES) return -1;
+    c->edges[c->n_edges].from = (uint8_t)from;
+    c->edges[c->n_edges].byte = byte;
+    c->edges[c->n_edges].to = (uint8_t)to;
+    c->n_edges++;
+    return to;
+}
+
+/* Sort edges by source state and index where each state's run starts */
+static void index_edges(Constraint *c) {
+    for (int i = 1; i < c->n_edges; i++) {
+        ConstraintEdge e = c->edges[i];
+        int j = i - 1;
+        while (j >= 0 && c->edges[j].from > e.from) {
+            c->edges[j + 1] = c->edges[j];
+            j--;
+        }
+        c->edges[j + 1] = e;
+    }
+    int e = 0;
+    for (int s = 0; s <= c->n_states; s++) {
+        while (e < c->n_edges && c->edges[e].from < s) e++;
+        c->first_edge[s] = (int16_t)e;
+    }
+}
+
+static int step(const Constraint *c, int state, uint8_t byte) {
+    for (int i = c->first_edge[state]; i < c->first_edge[state + 1]; i++) {
+        if (c->edges[i].byte == byte) return c->edges[i].to;
+    }
+    return -1;
+}
+
+int constraint_charset(Constraint *c, const char *chars) {
+    reset(c);
+    c->accepting[0] = 1;
+    for (const char *p = chars; *p; p++) {
+        if (add_edge(c, 0, (uint8_t)*p, 0) < 0) {
+            printf("Constraint: too many characters\n");
+            return -1;
+        }
+    }
+    index_edges(c);
+    return 0;
+}
+
+/*
+ * A trie of the words rooted at state 0, which also loops on spaces. The
+ * end of every word is accepting and goes back to the root on a space.
+ */
+int constraint_words(Constraint *c, const char *words) {
+    reset(c);
+    add_edge(c, 0, ' ', 0);
+    const char *p = words;
+    while (*p) {
+        int state = 0, len = 0;
+        for (; *p && *p != '|'; p++, len++) {
+            int next = -1;
+            for (int i = 0; i < c->n_edges; i++) {
+                if (c->edges[i].from == state &&
+                    c->edges[i].byte == (uint8_t)*p) {
+                    next = c->edges[i].to;
+                }
+            }
+            if (next < 0) {
+                next = add_state(c);
+                if (next < 0 || add_edge(c, state, (uint8_t)*p, next) < 0) {
+                    printf("Constraint: word list needs more than %d states "
+                           "or %d edges\n", MAX_CONSTRAINT_STATES,
+                           MAX_CONSTRAINT_EDGES);
+                    return -1;
+                }
+            }
+            state = next;
+        }
+        if (len > 0) {
+            c->accepting[state] = 1;
+            if (add_edge(c, state, ' ', 0) < 0) return -1;
+        }
+        if (*p == '|') p++;
+    }
+    index_edges(c);
+    return 0;
+}
+
+/* ---- Compilation against the vocab ---- */
+
+/* Bytes a token stands for, with <0xXX> byte tokens resolved */
+static const char *piece_bytes(Tokenizer *t, int token) {
+    char *piece = t->vocab[token];
+    unsigned char byte_val;
+    if (sscanf(piece, "<0x%02hhX>", &byte_val) == 1) {
+        return (const char *)t->byte_pieces + byte_val * 2;
+    }
+    return piece;
+}
+
+/* State after the token's bytes from state, -1 if the DFA dies */
+static int run_piece(const Constraint *c, int state, int token) {
+    const char *bytes = piece_bytes(c->tokenizer, token);
+    if (bytes[0] == '\0') return -1;
+    for (; *bytes && state >= 0; bytes++) {
+        state = step(c, state, (uint8_t)*bytes);
+    }
+    return state;
+}
+
+int constraint_compile(Constraint *c, Tokenizer *tokenizer, int vocab_size) {
+    c->tokenizer = tokenizer;
+    c->vocab_size = vocab_size;
+    for (int s = 0; s < c->n_states; s++) {
+        memset(c->mask[s], 0, sizeof(c->mask[s]));
+        c->n_allowed[s] = 0;
+        /* 0-2 are <unk>, BOS and EOS; BOS ends generation */
+        if (c->accepting[s]) {
+            c->mask[s][0] |= 1u << 1;
+            c->n_allowed[s]++;
+        }
+        for (int t = 3; t < vocab_size; t++) {
+            if (run_piece(c, s, t) >= 0) {
+                c->mask[s][t / 32] |= 1u << (t % 32);
+                c->n_allowed[s]++;
+            }
+        }
+    }
+    if (c->n_allowed[0] == 0) {
+        printf("Constraint: no token can start the output\n");
+        return -1;
+    }
+    printf("Constraint: %d states, %d tokens allowed at the start\n",
+           c->n_states, c->n_allowed[0]);
+    return 0;
+}
+
+const uint32_t *constraint_mask(const Constraint *c, int state) {
+    return c->mask[state];
+}
+
+int constraint_advance(const Constraint *c, int state, int token) {
+    if (state < 0 || token < 0 || token >= c->vocab_size ||
+        !(c->mask[state][token / 32] & (1u << (token % 32)))) {
+        return -1;
+    }
+    if (token == 1) return state;
+    return run_piece(c, state, token);
+}
@@ -0,0 +1,71 @@
+#ifndef CONSTRAINT_H
+#define CONSTRAINT_H
+
+#include <stdint.h>
+#include "transformer.h"
+#include "tokenizer.h"
+
+/*
+ * Constrained decoding. A constraint is a small DFA over output bytes,
+ * built from a character set or a word list. constraint_compile() runs
+ * every vocab piece through it from every state once, recording which
+ * tokens keep the DFA alive as one bitset per state. While generating,
+ * the sampler only looks at logits whose bit is set (a single pass over
+ * the bitset, see Sampler.mask) and the state advances by the emitted
+ * token's bytes, so no forward pass is spent on a token that would be
+ * filtered out afterwards. BOS, which ends generation, is allowed in
+ * accepting states only.
+ *
+ * The leading space decode() strips from a piece right after BOS isn't
+ * modelled: pieces are matched as stored.
+ */
+#ifndef MAX_CONSTRAINT_STATES
+#define MAX_CONSTRAINT_STATES 32
+#endif
+#ifndef MAX_CONSTRAINT_EDGES
+#define MAX_CONSTRAINT_EDGES 256
+#endif
+#define CONSTRAINT_MASK_WORDS ((MAX_VOCAB_SIZE + 31) / 32)
+
+typedef struct {
+    uint8_t from, byte, to;
+} ConstraintEdge;
+
+typedef struct {
+    int n_states;
+    int n_edges;
+    ConstraintEdge edges[MAX_CONSTRAINT_EDGES];     /* sorted by from */
+    int16_t first_edge[MAX_CONSTRAINT_STATES + 1];
+    uint8_t accepting[MAX_CONSTRAINT_STATES];
+    Tokenizer *tokenizer;
+    int vocab_size;
+    int n_allowed[MAX_CONSTRAINT_STATES];           /* tokens per mask */
+    uint32_t mask[MAX_CONSTRAINT_STATES][CONSTRAINT_MASK_WORDS];
+} Constraint;
+
+/**
+ * Output made only of bytes from chars, e.g. "0123456789" for digits.
+ * May end anywhere. Returns 0 on success.
+ */
+int constraint_charset(Constraint *c, const char *chars);
+
+/**
+ * One or more words from a '|'-separated list ("yes|no|maybe"), each
+ * optionally preceded by spaces, ending after a whole word. Returns 0 on
+ * success, -1 if the list needs more than MAX_CONSTRAINT_STATES states.
+ */
+int constraint_words(Constraint *c, const char *words);
+
+/**
+ * Build the per-state token bitsets against tokenizer's vocab. Returns 0
+ * on success, -1 if no token can start the output.
+ */
+int constraint_compile(Constraint *c, Tokenizer *tokenizer, int vocab_size);
+
+/** Tokens allowed in state: bit t of word t / 32. */
+const uint32_t *constraint_mask(const Constraint *c, int state);
+
+/** State after emitting token from state; -1 if the token wasn't allowed. */
+int constraint_advance(const Constraint *c, int state, int token);
+
+#endif /* CONSTRAINT_H */
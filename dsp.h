@@ -0,0 +1,62 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <stdint.h>
+
+/*
+ * Armv8-M DSP extension intrinsics used by the fixed-point kernels.
+ *
+ * On the M33 these map to single instructions via ACLE. Everywhere else
+ * they are portable C with the same bit-level results (wrapping adds, no
+ * saturation), so kernels can be checked on a Linux host.
+ */
+
+#if defined(__ARM_FEATURE_DSP)
+
+#include <arm_acle.h>
+
+/* acc + lo16(x)*lo16(y) + hi16(x)*hi16(y), signed, wrapping */
+static inline int32_t dsp_smlad(uint32_t x, uint32_t y, int32_t acc) {
+    return __smlad(x, y, acc);
+}
+
+/* Sign-extend bytes 0 and 2 into the two halfwords */
+static inline uint32_t dsp_sxtb16(uint32_t x) {
+    return __sxtb16(x);
+}
+
+/* Zero-extend bytes 0 and 2 into the two halfwords */
+static inline uint32_t dsp_uxtb16(uint32_t x) {
+    return __uxtb16(x);
+}
+
+static inline uint32_t dsp_ror(uint32_t x, uint32_t n) {
+    return __ror(x, n);
+}
+
+#else
+
+static inline int32_t dsp_smlad(uint32_t x, uint32_t y, int32_t acc) {
+    int32_t p0 = (int32_t)(int16_t)(x & 0xffff) * (int16_t)(y & 0xffff);
+    int32_t p1 = (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+    return (int32_t)((uint32_t)acc + (uint32_t)p0 + (uint32_t)p1);
+}
+
+static inline uint32_t dsp_sxtb16(uint32_t x) {
+    uint32_t lo = (uint16_t)(int16_t)(int8_t)(x & 0xff);
+    uint32_t hi = (uint16_t)(int16_t)(int8_t)((x >> 16) & 0xff);
+    return lo | (hi << 16);
+}
+
+static inline uint32_t dsp_uxtb16(uint32_t x) {
+    return x & 0x00ff00ffu;
+}
+
+static inline uint32_t dsp_ror(uint32_t x, uint32_t n) {
+    n &= 31;
+    return n ? (x >> n) | (x << (32 - n)) : x;
+}
+
+#endif
+
+#endif /* DSP_H */
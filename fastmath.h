@@ -0,0 +1,85 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Branch-free approximations of the transcendentals in the forward pass
+ * and sampler. newlib's expf is generic and slow on the M33; these are a
+ * handful of FPU ops each, and written so that loops over them vectorise
+ * on the host. Bounds below are relative to a double-precision reference
+ * and are checked by tools/mathcheck.c.
+ *
+ *   fast_expf     rel err < 1.5e-7 on [-87.3, 88.3]; 0 below -87.3
+ *                 (so exp(-inf) is 0), saturates at 2.4e38 above
+ *   fast_rsqrtf   rel err < 5e-6 for positive normal inputs
+ *   fast_silu     rel err < 3e-7 (inherits fast_expf plus one divide)
+ */
+
+/*
+ * USE_FAST_MATH selects these over libm in the scalar and SIMD kernels
+ * (softmax, rmsnorm, SiLU). Off by default, so output stays bit-for-bit
+ * comparable with llama2.c's run.c.
+ */
+#ifndef USE_FAST_MATH
+#define USE_FAST_MATH 0
+#endif
+
+#define FAST_EXP_LO  (-87.33654f)     /* below this, 2^n would be subnormal */
+#define FAST_EXP_HI  88.37626f
+
+/* Cephes-style split of ln 2 so n * ln 2 is exact in the high part */
+#define FAST_LN2_HI  0.693359375f
+#define FAST_LN2_LO  (-2.12194440e-4f)
+#define FAST_LOG2E   1.44269504088896341f
+
+/* Minimax polynomial for (e^r - 1 - r) / r^2 on [-ln2/2, ln2/2] */
+#define FAST_EXP_P0  1.9875691500e-4f
+#define FAST_EXP_P1  1.3981999507e-3f
+#define FAST_EXP_P2  8.3334519073e-3f
+#define FAST_EXP_P3  4.1665795894e-2f
+#define FAST_EXP_P4  1.6666665459e-1f
+#define FAST_EXP_P5  5.0000001201e-1f
+
+/* e^x = 2^n * e^r with n = round(x / ln 2), |r| <= ln 2 / 2 */
+static inline float fast_expf(float x) {
+    float xc = x > FAST_EXP_HI ? FAST_EXP_HI : x;
+    xc = xc < FAST_EXP_LO ? FAST_EXP_LO : xc;
+    float fn = (float)(int32_t)(xc * FAST_LOG2E + (xc < 0.0f ? -0.5f : 0.5f));
+    float r = xc - fn * FAST_LN2_HI - fn * FAST_LN2_LO;
+    float p = FAST_EXP_P0;
+    p = p * r + FAST_EXP_P1;
+    p = p * r + FAST_EXP_P2;
+    p = p * r + FAST_EXP_P3;
+    p = p * r + FAST_EXP_P4;
+    p = p * r + FAST_EXP_P5;
+    p = p * r * r + r + 1.0f;
+    uint32_t bits = (uint32_t)((int32_t)fn + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return x < FAST_EXP_LO ? 0.0f : p * scale;
+}
+
+/* Bit-trick seed, then two Newton-Raphson steps */
+static inline float fast_rsqrtf(float x) {
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86u - (i >> 1);
+    float y;
+    memcpy(&y, &i, sizeof(y));
+    float hx = 0.5f * x;
+    y = y * (1.5f - hx * y * y);
+    y = y * (1.5f - hx * y * y);
+    return y;
+}
+
+static inline float fast_sigmoidf(float x) {
+    return 1.0f / (1.0f + fast_expf(-x));
+}
+
+static inline float fast_silu(float x) {
+    return x * fast_sigmoidf(x);
+}
+
+#endif /* FASTMATH_H */
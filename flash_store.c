@@ -0,0 +1,67 @@
+#include "flash_store.h"
+#include <stdio.h>
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "pico/flash.h"
+
+#define STORE_OFFSET (PICO_FLASH_SIZE_BYTES - SESSION_FLASH_SIZE)
+
+/* The flash size the build checked the image against (EmbedModel.cmake) */
+#if defined(PICO_LLAMA_FLASH_SIZE) && \
+    PICO_LLAMA_FLASH_SIZE != PICO_FLASH_SIZE_BYTES
+#error "pico_llama_embed_model() FLASH_SIZE differs from the board's flash"
+#endif
+
+/*
+ * Flash can't be read while it is being written, so these run with XIP
+ * and interrupts off via flash_safe_execute(). SDK 2.1+ saves and
+ * restores the QMI CS1 (PSRAM) setup around the operation.
+ */
+typedef struct {
+    uint32_t offset;
+    const uint8_t *data;
+    uint32_t bytes;
+} FlashOp;
+
+static void do_erase(void *param) {
+    FlashOp *op = (FlashOp *)param;
+    flash_range_erase(STORE_OFFSET + op->offset, op->bytes);
+}
+
+static void do_program(void *param) {
+    FlashOp *op = (FlashOp *)param;
+    flash_range_program(STORE_OFFSET + op->offset, op->data, op->bytes);
+}
+
+static int in_range(uint32_t offset, uint32_t bytes, uint32_t unit) {
+    return offset % unit == 0 && bytes % unit == 0 &&
+           offset <= SESSION_FLASH_SIZE &&
+           bytes <= SESSION_FLASH_SIZE - offset;
+}
+
+int flash_store_erase(uint32_t offset, uint32_t bytes) {
+    if (!in_range(offset, bytes, FLASH_STORE_SECTOR)) return -1;
+    FlashOp op = { offset, NULL, bytes };
+    int rc = flash_safe_execute(do_erase, &op, UINT32_MAX);
+    if (rc != PICO_OK) {
+        printf("Flash: erase failed (rc=%d)\n", rc);
+        return -1;
+    }
+    return 0;
+}
+
+int flash_store_program(uint32_t offset, const uint8_t *data, uint32_t bytes) {
+    if (!in_range(offset, bytes, FLASH_STORE_PAGE)) return -1;
+    FlashOp op = { offset, data, bytes };
+    int rc = flash_safe_execute(do_program, &op, UINT32_MAX);
+    if (rc != PICO_OK) {
+        printf("Flash: program failed (rc=%d)\n", rc);
+        return -1;
+    }
+    return 0;
+}
+
+const uint8_t *flash_store_read(uint32_t offset) {
+    if (offset >= SESSION_FLASH_SIZE) return NULL;
+    return (const uint8_t *)(XIP_BASE + STORE_OFFSET + offset);
+}
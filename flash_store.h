@@ -0,0 +1,38 @@
+#ifndef FLASH_STORE_H
+#define FLASH_STORE_H
+
+#include <stdint.h>
+
+/*
+ * A reserved region at the top of flash for data that must survive a
+ * reboot (session.h). NOR rules apply: erase whole sectors to 0xff, then
+ * program whole pages, which can only clear bits. Reads go through the
+ * XIP window. The model blob and firmware must end below the region:
+ * pico_llama_embed_model() (cmake/EmbedModel.cmake) sets the size, keeps
+ * its flash budget below the region and makes the link fail if the
+ * image overlaps it.
+ */
+#ifndef SESSION_FLASH_SIZE
+#define SESSION_FLASH_SIZE (512 * 1024)
+#endif
+#define FLASH_STORE_SECTOR 4096
+#define FLASH_STORE_PAGE   256
+
+#ifdef PICO_LLAMA_HOST
+/* Host builds keep the region in this file (host/flash_host.c) */
+extern const char *flash_host_path;
+#endif
+
+/** Erase bytes from offset; both must be multiples of FLASH_STORE_SECTOR. */
+int flash_store_erase(uint32_t offset, uint32_t bytes);
+
+/**
+ * Program bytes from data (in RAM) at offset; both must be multiples of
+ * FLASH_STORE_PAGE and the range erased. Returns 0 on success.
+ */
+int flash_store_program(uint32_t offset, const uint8_t *data, uint32_t bytes);
+
+/** Memory-mapped view of the region at offset, or NULL if unavailable. */
+const uint8_t *flash_store_read(uint32_t offset);
+
+#endif /* FLASH_STORE_H */
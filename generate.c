@@ -2,63 +2,251 @@
 #include <stdio.h>
 #include <string.h>
 #include "pico/time.h"
+#include "telemetry.h"
 
-void generate(Transformer *transformer, Tokenizer *tokenizer,
-              Sampler *sampler, char *prompt, int steps) {
-    char *empty_prompt = "";
-    if (prompt == NULL) prompt = empty_prompt;
+/* ---- Step API ---- */
+
+int gen_init(GenContext *ctx, Transformer *transformer, Tokenizer *tokenizer,
+             Sampler *sampler, const char *prompt, int steps, int stream) {
+    if (prompt == NULL) prompt = "";
 
-    if (steps == 0 || steps > transformer->config.seq_len) {
+    /* Streaming runs past seq_len on the rolling KV cache; steps=0 there
+       means no limit */
+    if (!stream && (steps == 0 || steps > transformer->config.seq_len)) {
         steps = transformer->config.seq_len;
     }
 
-    /* Encode prompt — static buffer, max tokens = prompt length + 3 */
-    int prompt_tokens[MAX_SEQ_LEN];
-    int num_prompt_tokens = 0;
-    encode(tokenizer, prompt, 1, 0, prompt_tokens, &num_prompt_tokens);
+    /* encode() needs room for prompt length + 3 tokens */
+    if (strlen(prompt) + 3 > MAX_SEQ_LEN) {
+        printf("Error: prompt longer than %d bytes\n", MAX_SEQ_LEN - 3);
+        return -1;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->transformer = transformer;
+    ctx->tokenizer = tokenizer;
+    ctx->sampler = sampler;
+    ctx->steps = steps;
+    ctx->start_us = time_us_64();
+    encode(tokenizer, (char *)prompt, 1, 0, ctx->prompt, &ctx->n_prompt);
 
-    if (num_prompt_tokens < 1) {
+    if (ctx->n_prompt < 1) {
         printf("Error: expected at least 1 prompt token\n");
-        return;
+        return -1;
+    }
+    ctx->token = ctx->prompt[0];
+    ctx->stop = GEN_RUNNING;
+    return 0;
+}
+
+int gen_resume(GenContext *ctx, Transformer *transformer, Tokenizer *tokenizer,
+               Sampler *sampler, int pos, int token, int steps) {
+    if (pos < 0 || token < 0 || token >= transformer->config.vocab_size) {
+        printf("Error: cannot resume at pos %d with token %d\n", pos, token);
+        return -1;
     }
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->transformer = transformer;
+    ctx->tokenizer = tokenizer;
+    ctx->sampler = sampler;
+    ctx->steps = steps ? pos + steps : 0;
+    ctx->start_us = time_us_64();
+    /* n_prompt = 0: gen_step() goes straight to sampling */
+    ctx->pos = pos;
+    ctx->token = token;
+    ctx->stop = GEN_RUNNING;
+    return 0;
+}
 
-    printf("Prompt encoded to %d tokens\n", num_prompt_tokens);
-    printf("Generating %d tokens...\n\n", steps);
+void gen_constrain(GenContext *ctx, const Constraint *c) {
+    ctx->constraint = c;
+    ctx->constraint_state = 0;
+}
+
+int gen_step(GenContext *ctx, GenToken *tok) {
+    if (ctx->stop != GEN_RUNNING) return 0;
 
-    uint64_t start = 0;
+    uint64_t t0 = time_us_64();
     int next;
-    int token = prompt_tokens[0];
-    int pos = 0;
+    for (;;) {
+        /* Checked every pass so a long prefill can be cancelled too */
+        if (ctx->cancel) {
+            ctx->stop = GEN_STOP_CANCELLED;
+            return 0;
+        }
+        if (ctx->steps != 0 && ctx->pos >= ctx->steps) {
+            ctx->stop = GEN_STOP_STEPS;
+            return 0;
+        }
 
-    while (pos < steps) {
-        float *logits = forward(transformer, token, pos);
+        /* While the model is still streaming in (loader.h), run the prompt
+           through forward_batch(): it goes layer by layer, so all of a
+           batch's positions get computed behind the copy instead of
+           position 0 waiting for the last layer */
+        if (ctx->transformer->loading && ctx->pos < ctx->n_prompt - 1) {
+            int n = ctx->n_prompt - 1 - ctx->pos;
+            if (n > MAX_BATCH) n = MAX_BATCH;
+            if (ctx->steps != 0 && ctx->pos + n > ctx->steps) {
+                n = ctx->steps - ctx->pos;
+            }
+            if (forward_batch(ctx->transformer, ctx->prompt + ctx->pos, n,
+                              ctx->pos)) {
+                ctx->pos += n;
+                ctx->token = ctx->prompt[ctx->pos];
+                continue;
+            }
+        }
+        float *logits = forward(ctx->transformer, ctx->token, ctx->pos);
 
-        if (pos < num_prompt_tokens - 1) {
-            next = prompt_tokens[pos + 1];
-        } else {
-            next = sample(sampler, logits);
+        /* Prefill: feed the prompt, nothing to hand out yet */
+        if (ctx->pos < ctx->n_prompt - 1) {
+            ctx->pos++;
+            ctx->token = ctx->prompt[ctx->pos];
+            continue;
+        }
+        if (ctx->pos == ctx->n_prompt - 1) {
+            ctx->prefill_us = time_us_64() - ctx->start_us;
         }
-        pos++;
+        if (ctx->constraint) {
+            ctx->sampler->mask = constraint_mask(ctx->constraint,
+                                                 ctx->constraint_state);
+        }
+        next = sample(ctx->sampler, logits);
+        ctx->sampler->mask = NULL;
+        ctx->pos++;
+        break;
+    }
 
-        /* BOS token = stop */
-        if (next == 1) break;
+    /* BOS token = stop; resuming feeds it, starting a new story */
+    if (next == 1) {
+        ctx->token = next;
+        ctx->stop = ctx->constraint &&
+                    ctx->constraint->n_allowed[ctx->constraint_state] == 0 ?
+                    GEN_STOP_CONSTRAINT : GEN_STOP_BOS;
+        return 0;
+    }
+    if (ctx->constraint) {
+        ctx->constraint_state = constraint_advance(ctx->constraint,
+                                                   ctx->constraint_state, next);
+    }
 
-        char *piece = decode(tokenizer, token, next);
-        safe_printf(piece);
-        /* Flush after each token for streaming effect */
-        fflush(stdout);
-        token = next;
+    uint64_t now = time_us_64();
+    tok->id = next;
+    tok->piece = decode(ctx->tokenizer, ctx->token, next);
+    tok->pos = ctx->pos;
+    tok->index = ctx->generated;
+    tok->latency_us = now - t0;
+    tok->elapsed_us = now - ctx->start_us;
 
-        /* Start timing after first generated token */
-        if (start == 0) start = time_us_64();
+    if (ctx->generated == 0) {
+        ctx->first_token_us = now;
+    } else {
+        telemetry_record(TELEM_DECODE, now - t0);
     }
+    ctx->last_token_us = now;
+    ctx->generated++;
+    ctx->token = next;
+    return 1;
+}
+
+void gen_cancel(GenContext *ctx) {
+    ctx->cancel = 1;
+}
+
+void gen_finish(GenContext *ctx, GenStats *stats) {
+    if (ctx->stop == GEN_RUNNING) ctx->stop = GEN_STOP_CANCELLED;
+
+    GenStats s;
+    s.prompt_tokens = ctx->n_prompt;
+    s.generated = ctx->generated;
+    s.prefill_us = ctx->prefill_us;
+    s.ttft_us = ctx->generated ? ctx->first_token_us - ctx->start_us : 0;
+    s.decode_us = ctx->generated ? ctx->last_token_us - ctx->first_token_us : 0;
+    s.stop = ctx->stop;
+    s.pos = ctx->pos;
+    s.token = ctx->token;
+
+    if (ctx->prefill_us) telemetry_record(TELEM_PREFILL, s.prefill_us);
+    if (ctx->generated) telemetry_record(TELEM_TTFT, s.ttft_us);
+    if (stats) *stats = s;
+}
+
+/* Step to the end, timing each hand-over to cb as output-write time */
+static void run_to_end(GenContext *ctx, GenCallback cb, void *user) {
+    GenToken tok;
+    while (gen_step(ctx, &tok)) {
+        uint64_t t0 = time_us_64();
+        int stop = cb(&tok, user);
+        telemetry_record(TELEM_WRITE, time_us_64() - t0);
+        if (stop) gen_cancel(ctx);
+    }
+}
+
+int generate_cb(Transformer *transformer, Tokenizer *tokenizer,
+                Sampler *sampler, const char *prompt, int steps, int stream,
+                GenCallback cb, void *user, GenStats *stats) {
+    GenContext ctx;
+    if (gen_init(&ctx, transformer, tokenizer, sampler, prompt, steps,
+                 stream) != 0) {
+        return -1;
+    }
+    run_to_end(&ctx, cb, user);
+    gen_finish(&ctx, stats);
+    return 0;
+}
+
+/* ---- Serial consumer ---- */
+
+static int serial_token(const GenToken *tok, void *user) {
+    (void)user;
+    safe_printf((char *)tok->piece);
+    /* Flush after each token for streaming effect */
+    fflush(stdout);
+    return 0;
+}
+
+void generate_print(GenContext *ctx, GenStats *stats) {
+    if (ctx->n_prompt > 0) {
+        printf("Prompt encoded to %d tokens\n", ctx->n_prompt);
+    } else {
+        printf("Resuming at pos %d\n", ctx->pos);
+    }
+    if (ctx->steps == 0) {
+        printf("Generating until BOS...\n\n");
+    } else {
+        printf("Generating %d tokens...\n\n", ctx->steps - ctx->pos);
+    }
+
+    run_to_end(ctx, serial_token, NULL);
+    GenStats s;
+    gen_finish(ctx, &s);
     printf("\n");
 
-    if (pos > 1) {
-        uint64_t end = time_us_64();
-        double elapsed_ms = (double)(end - start) / 1000.0;
-        double toks = (pos - 1) / (elapsed_ms / 1000.0);
+    /* Decode rate, timed from the first generated token */
+    if (s.generated > 1) {
+        double elapsed_ms = (double)s.decode_us / 1000.0;
+        double toks = (s.generated - 1) / (elapsed_ms / 1000.0);
         printf("\n--- %d tokens in %.1f ms = %.1f tok/s ---\n",
-               pos - 1, elapsed_ms, toks);
+               s.generated - 1, elapsed_ms, toks);
+    }
+    telemetry_dump();
+    if (stats) *stats = s;
+}
+
+void generate(Transformer *transformer, Tokenizer *tokenizer,
+              Sampler *sampler, char *prompt, int steps) {
+    GenContext ctx;
+    if (gen_init(&ctx, transformer, tokenizer, sampler, prompt, steps,
+                 0) == 0) {
+        generate_print(&ctx, NULL);
+    }
+}
+
+void generate_stream(Transformer *transformer, Tokenizer *tokenizer,
+                     Sampler *sampler, char *prompt, int steps) {
+    GenContext ctx;
+    if (gen_init(&ctx, transformer, tokenizer, sampler, prompt, steps,
+                 1) == 0) {
+        generate_print(&ctx, NULL);
     }
 }
@@ -1,9 +1,125 @@
 #ifndef GENERATE_H
 #define GENERATE_H
 
+#include <stdint.h>
 #include "transformer.h"
 #include "tokenizer.h"
 #include "sampler.h"
+#include "constraint.h"
+
+/* Why a generation ended */
+typedef enum {
+    GEN_RUNNING = 0,
+    GEN_STOP_BOS,       /* model emitted BOS */
+    GEN_STOP_STEPS,     /* reached the step limit */
+    GEN_STOP_CANCELLED, /* gen_cancel() or the callback asked to stop */
+    GEN_STOP_CONSTRAINT,  /* the constraint allows no further token */
+} GenStop;
+
+/* One generated token, as handed to consumers */
+typedef struct {
+    int id;
+    const char *piece;  /* decoded bytes; points into the tokenizer */
+    int pos;            /* position the token will occupy */
+    int index;          /* 0 for the first generated token */
+    uint64_t latency_us;  /* forward + sample (whole prefill for index 0) */
+    uint64_t elapsed_us;  /* since gen_init() */
+} GenToken;
+
+typedef struct {
+    int prompt_tokens;
+    int generated;
+    uint64_t prefill_us;
+    uint64_t ttft_us;     /* until the first token was handed over */
+    uint64_t decode_us;   /* first token handed over to the end */
+    GenStop stop;
+    int pos;              /* where a later gen_resume() would continue... */
+    int token;            /* ...and the token it would feed there */
+} GenStats;
+
+/*
+ * A generation in progress. Lives wherever the caller puts it (stack or
+ * static); stepping it does not allocate or format anything.
+ */
+typedef struct {
+    Transformer *transformer;
+    Tokenizer *tokenizer;
+    Sampler *sampler;
+    int prompt[MAX_SEQ_LEN];
+    int n_prompt;
+    int steps;            /* position limit; 0 = none (streaming) */
+    int pos;
+    int token;
+    int generated;
+    const Constraint *constraint;   /* NULL = unconstrained */
+    int constraint_state;
+    volatile int cancel;  /* may be set from another core or an IRQ */
+    GenStop stop;
+    uint64_t start_us;
+    uint64_t prefill_us;
+    uint64_t first_token_us;
+    uint64_t last_token_us;
+} GenContext;
+
+/*
+ * Called for every generated token. Return nonzero to stop generation;
+ * the token being delivered still counts.
+ */
+typedef int (*GenCallback)(const GenToken *tok, void *user);
+
+/**
+ * Encode the prompt and set up a generation. steps limits positions
+ * (prompt included) as in llama2.c; 0 means seq_len, or no limit when
+ * stream is set (rolling KV cache past seq_len). Returns 0 on success.
+ */
+int gen_init(GenContext *ctx, Transformer *transformer, Tokenizer *tokenizer,
+             Sampler *sampler, const char *prompt, int steps, int stream);
+
+/**
+ * Set up a generation that continues an existing KV cache, e.g. one
+ * brought back by session_restore(): token is fed at pos, with no prompt.
+ * steps limits further positions (0 = none); the cache may roll past
+ * seq_len. Returns 0 on success.
+ */
+int gen_resume(GenContext *ctx, Transformer *transformer, Tokenizer *tokenizer,
+               Sampler *sampler, int pos, int token, int steps);
+
+/**
+ * Restrict the rest of a generation set up by gen_init() or gen_resume()
+ * to output accepted by c (compiled; see constraint.h), starting from its
+ * initial state. The sampler only considers the allowed tokens.
+ */
+void gen_constrain(GenContext *ctx, const Constraint *c);
+
+/**
+ * Produce the next token into *tok, running the prompt prefill first if
+ * it hasn't been. Returns 1 for a token, 0 once generation has stopped.
+ */
+int gen_step(GenContext *ctx, GenToken *tok);
+
+/**
+ * Ask a running generation to stop before its next token, or before the
+ * next prompt position if it is still in prefill.
+ */
+void gen_cancel(GenContext *ctx);
+
+/** Summarise a finished (or abandoned) generation and record telemetry. */
+void gen_finish(GenContext *ctx, GenStats *stats);
+
+/**
+ * Drive gen_step() to completion, handing each token to cb. Telemetry
+ * counts the time spent in cb as output-write time. Returns 0 on success.
+ */
+int generate_cb(Transformer *transformer, Tokenizer *tokenizer,
+                Sampler *sampler, const char *prompt, int steps, int stream,
+                GenCallback cb, void *user, GenStats *stats);
+
+/**
+ * Run a generation set up by gen_init() or gen_resume() to the end,
+ * streaming it over USB serial with the tok/s line and telemetry.
+ * stats (optional) receives the summary, including where to resume.
+ */
+void generate_print(GenContext *ctx, GenStats *stats);
 
 /**
  * Generate tokens from prompt. Streams output over USB serial and
@@ -12,4 +128,12 @@
 void generate(Transformer *transformer, Tokenizer *tokenizer,
               Sampler *sampler, char *prompt, int steps);
 
+/**
+ * Like generate(), but keeps going past seq_len on the rolling KV cache
+ * (attention sinks + sliding window), at constant memory and per-token
+ * cost. steps=0 means run until the model emits BOS.
+ */
+void generate_stream(Transformer *transformer, Tokenizer *tokenizer,
+                     Sampler *sampler, char *prompt, int steps);
+
 #endif /* GENERATE_H */
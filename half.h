@@ -0,0 +1,97 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * IEEE binary16 (fp16) and bfloat16 conversions.
+ *
+ * With -mfp16-format=ieee the compiler lowers __fp16 casts to the M33's
+ * VCVTB instructions; elsewhere the bit-twiddling fallback is used. Both
+ * round to nearest-even when narrowing and are exact when widening.
+ */
+
+static inline float half_bits_to_f32(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static inline uint32_t half_f32_to_bits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+#if defined(__ARM_FP16_FORMAT_IEEE)
+
+static inline float f16_to_f32(uint16_t h) {
+    __fp16 v;
+    memcpy(&v, &h, sizeof(v));
+    return (float)v;
+}
+
+static inline uint16_t f32_to_f16(float f) {
+    __fp16 v = (__fp16)f;
+    uint16_t h;
+    memcpy(&h, &v, sizeof(h));
+    return h;
+}
+
+#else
+
+static inline float f16_to_f32(uint16_t h) {
+    const uint32_t shifted_exp = 0x7c00u << 13;
+    uint32_t o = ((uint32_t)h & 0x7fffu) << 13;
+    uint32_t exp = o & shifted_exp;
+    o += (uint32_t)(127 - 15) << 23;
+    if (exp == shifted_exp) {
+        o += (uint32_t)(128 - 16) << 23;            /* Inf / NaN */
+    } else if (exp == 0) {
+        o += 1u << 23;                              /* subnormal */
+        o = half_f32_to_bits(half_bits_to_f32(o) -
+                             half_bits_to_f32(113u << 23));
+    }
+    o |= ((uint32_t)h & 0x8000u) << 16;
+    return half_bits_to_f32(o);
+}
+
+static inline uint16_t f32_to_f16(float f) {
+    uint32_t u = half_f32_to_bits(f);
+    uint32_t sign = u & 0x80000000u;
+    uint16_t o;
+    u ^= sign;
+
+    if (u >= (143u << 23)) {
+        /* Overflow to Inf, or NaN (quiet, keeping it a NaN) */
+        o = (u > (255u << 23)) ? 0x7e00 : 0x7c00;
+    } else if (u < (113u << 23)) {
+        /* Subnormal or zero: let the FPU do the rounding */
+        u = half_f32_to_bits(half_bits_to_f32(u) + half_bits_to_f32(126u << 23));
+        o = (uint16_t)(u - (126u << 23));
+    } else {
+        uint32_t mant_odd = (u >> 13) & 1;
+        u += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        u += mant_odd;
+        o = (uint16_t)(u >> 13);
+    }
+    return o | (uint16_t)(sign >> 16);
+}
+
+#endif
+
+static inline float bf16_to_f32(uint16_t h) {
+    return half_bits_to_f32((uint32_t)h << 16);
+}
+
+static inline uint16_t f32_to_bf16(float f) {
+    uint32_t u = half_f32_to_bits(f);
+    if ((u & 0x7fffffffu) > 0x7f800000u) {
+        return (uint16_t)((u >> 16) | 0x40);        /* keep NaN quiet */
+    }
+    u += 0x7fff + ((u >> 16) & 1);
+    return (uint16_t)(u >> 16);
+}
+
+#endif /* HALF_H */
@@ -0,0 +1,69 @@
+/* flash_host.c - file-backed session flash region for host builds */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash_store.h"
+
+const char *flash_host_path = "pico_llama.flash";
+
+static uint8_t region[SESSION_FLASH_SIZE];
+static int loaded = 0;
+
+/* Read the file once; a missing or short file reads as erased flash */
+static void load(void) {
+    if (loaded) return;
+    memset(region, 0xff, sizeof(region));
+    FILE *f = fopen(flash_host_path, "rb");
+    if (f) {
+        size_t n = fread(region, 1, sizeof(region), f);
+        (void)n;
+        fclose(f);
+    }
+    loaded = 1;
+}
+
+static int save(uint32_t offset, uint32_t bytes) {
+    FILE *f = fopen(flash_host_path, "r+b");
+    if (!f) {
+        /* First write: create the file at full size */
+        f = fopen(flash_host_path, "wb");
+        if (!f) {
+            printf("Flash: cannot write %s\n", flash_host_path);
+            return -1;
+        }
+        size_t n = fwrite(region, 1, sizeof(region), f);
+        fclose(f);
+        return n == sizeof(region) ? 0 : -1;
+    }
+    fseek(f, (long)offset, SEEK_SET);
+    size_t n = fwrite(region + offset, 1, bytes, f);
+    fclose(f);
+    return n == bytes ? 0 : -1;
+}
+
+static int in_range(uint32_t offset, uint32_t bytes, uint32_t unit) {
+    return offset % unit == 0 && bytes % unit == 0 &&
+           offset <= SESSION_FLASH_SIZE &&
+           bytes <= SESSION_FLASH_SIZE - offset;
+}
+
+int flash_store_erase(uint32_t offset, uint32_t bytes) {
+    if (!in_range(offset, bytes, FLASH_STORE_SECTOR)) return -1;
+    load();
+    memset(region + offset, 0xff, bytes);
+    return save(offset, bytes);
+}
+
+int flash_store_program(uint32_t offset, const uint8_t *data, uint32_t bytes) {
+    if (!in_range(offset, bytes, FLASH_STORE_PAGE)) return -1;
+    load();
+    /* Like NOR flash, programming can only clear bits */
+    for (uint32_t i = 0; i < bytes; i++) region[offset + i] &= data[i];
+    return save(offset, bytes);
+}
+
+const uint8_t *flash_store_read(uint32_t offset) {
+    if (offset >= SESSION_FLASH_SIZE) return NULL;
+    load();
+    return region + offset;
+}
@@ -0,0 +1,308 @@
+/* main_host.c - run the Pico LLaMA inference core on a Linux/macOS host
+ *
+ *   pico_llama_host model.bin tokenizer.bin [options]
+ *
+ * Same code path as the firmware (PSRAM window, static RunState, weight
+ * conversion, placement), with the model and tokenizer read from files and
+ * the compute kernels picked for the host CPU (kernels.h). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/time.h"
+#include "psram.h"
+#include "psram_alloc.h"
+#include "models.h"
+#include "sampler.h"
+#include "generate.h"
+#include "beam.h"
+#include "score.h"
+#include "session.h"
+#include "flash_store.h"
+
+static Sampler sampler;
+static Constraint constraint;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s model.bin tokenizer.bin [options]\n"
+            "  -t <float>  temperature (default 1.0)\n"
+            "  -p <float>  top-p (default 0.9)\n"
+            "  -s <int>    RNG seed (default: time)\n"
+            "  -n <int>    steps, 0 = seq_len (default 256)\n"
+            "  -i <text>   prompt (default \"Once upon a time\")\n"
+            "  -r          stream past seq_len on the rolling KV cache\n"
+            "  -a <file>   keep another model resident (same tokenizer) and\n"
+            "              run the prompt on each in turn\n"
+            "  -S <file>   session flash file: resume from it if it holds a\n"
+            "              session for this model, save to it at the end\n"
+            "  -k <type>   KV format for -S: f32, f16, bf16, q8, q4 (default f16)\n"
+            "  -b <width>  beam search, printing the n-best list\n"
+            "  -f <file>   score the text in file instead of generating:\n"
+            "              perplexity per model, blank-line separated\n"
+            "              documents each starting from BOS\n"
+            "  -w <int>    scoring window stride, 0 = seq_len/2 (default 0)\n"
+            "  -C <chars>  only output bytes from chars, e.g. 0123456789\n"
+            "  -W <words>  only output words from a list, e.g. \"yes|no\"\n"
+            "  -e <float>  early exit once the top token is this likely\n"
+            "              (see tools/exitcheck.c; default 0 = off)\n"
+            "  -E <int>    with -e, check every this many layers (default 1)\n",
+            prog);
+}
+
+/* Read a whole file into dst (at most cap bytes); returns size or -1 */
+static long read_file(const char *path, void *dst, size_t cap) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("Host: cannot open %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 0 || (size_t)size > cap) {
+        printf("Host: %s is %ld bytes, limit %u\n", path, size, (unsigned)cap);
+        fclose(f);
+        return -1;
+    }
+    if (fread(dst, 1, (size_t)size, f) != (size_t)size) {
+        printf("Host: short read on %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return size;
+}
+
+/* Read a model file straight into its own PSRAM region and register it */
+static int load_model(const char *path, const unsigned char *tok_data,
+                      unsigned int tok_size) {
+    size_t cap = psram_largest_free();
+    uint8_t *region = psram_alloc(cap, path);
+    if (region == NULL) return -1;
+    long size = read_file(path, region, cap);
+    if (size <= 0) {
+        psram_free(region);
+        return -1;
+    }
+    psram_shrink(region, (size_t)size);
+    printf("Model: %ld bytes from %s\n", size, path);
+    return model_adopt(path, region, tok_data, tok_size);
+}
+
+/*
+ * One request against the session file: continue the saved session if
+ * there is one (timing a re-prefill for comparison), else start from the
+ * prompt; then save where it ended.
+ */
+static int run_session(const char *path, WeightType kv_type,
+                       float temperature, float topp,
+                       unsigned long long seed, char *prompt, int steps) {
+    Model *m = model_use(0);
+    Transformer *t = &m->transformer;
+    static GenContext ctx;
+    init_sampler(&sampler, t->config.vocab_size, temperature, topp, seed);
+    flash_host_path = path;
+
+    int pos, token;
+    uint64_t t0 = time_us_64();
+    if (session_restore(t, &sampler, &pos, &token) == 0) {
+        uint64_t restore_us = time_us_64() - t0;
+        uint64_t prefill_us = session_reprefill_us(t, pos);
+        if (prefill_us) {
+            printf("Session: restore %llu us vs re-prefill %llu us (%.1fx)\n",
+                   (unsigned long long)restore_us,
+                   (unsigned long long)prefill_us,
+                   restore_us ? (double)prefill_us / restore_us : 0.0);
+            /* Continue from the saved cache, not the recomputed one */
+            session_restore(t, &sampler, &pos, &token);
+        }
+        if (gen_resume(&ctx, t, m->tokenizer, &sampler, pos, token,
+                       steps) != 0) {
+            return 1;
+        }
+        printf("\n=== Resuming ===\n\n");
+    } else {
+        if (gen_init(&ctx, t, m->tokenizer, &sampler, prompt, steps, 0) != 0) {
+            return 1;
+        }
+        printf("\n=== Generating ===\n\n");
+    }
+
+    GenStats stats;
+    generate_print(&ctx, &stats);
+    return session_save(t, &sampler, stats.pos, stats.token, kv_type) < 0;
+}
+
+/*
+ * Teacher-forced perplexity of the current model over a text file. Each
+ * paragraph (blank-line separated) is a document scored from BOS.
+ */
+static int score_file(Model *m, char *text, int stride) {
+    ScoreStats stats;
+    memset(&stats, 0, sizeof(stats));
+    int docs = 0;
+    char *doc = text;
+    while (*doc) {
+        char *end = strstr(doc, "\n\n");
+        char *next = end ? end + 2 : doc + strlen(doc);
+        if (end) *end = '\0';
+        while (*doc == '\n') doc++;
+        if (*doc) {
+            if (score_text(&m->transformer, m->tokenizer, doc, stride,
+                           &stats) != 0) {
+                return 1;
+            }
+            docs++;
+        }
+        if (end) *end = '\n';
+        doc = next;
+    }
+    printf("Score: %d documents\n", docs);
+    score_print(&stats);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *model_path = argv[1];
+    const char *tok_path = argv[2];
+    float temperature = 1.0f, topp = 0.9f;
+    unsigned long long seed = 0;
+    int steps = 256, stream = 0;
+    char *prompt = "Once upon a time";
+    const char *extra[MAX_MODELS] = { 0 };
+    int n_extra = 0;
+    const char *session_path = NULL;
+    int beam_width = 0;
+    const char *score_path = NULL;
+    int stride = 0;
+    const char *charset = NULL, *words = NULL;
+    float exit_threshold = 0.0f;
+    int exit_every = EARLY_EXIT_EVERY;
+    WeightType kv_type = SESSION_KV_TYPE;
+
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            stream = 1;
+            continue;
+        }
+        if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        char *val = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 't': temperature = (float)atof(val); break;
+        case 'p': topp = (float)atof(val); break;
+        case 's': seed = strtoull(val, NULL, 10); break;
+        case 'n': steps = atoi(val); break;
+        case 'i': prompt = val; break;
+        case 'a':
+            if (n_extra + 1 == MAX_MODELS) {
+                printf("Host: at most %d models (MAX_MODELS)\n", MAX_MODELS);
+                return 1;
+            }
+            extra[n_extra++] = val;
+            break;
+        case 'S': session_path = val; break;
+        case 'b': beam_width = atoi(val); break;
+        case 'f': score_path = val; break;
+        case 'w': stride = atoi(val); break;
+        case 'C': charset = val; break;
+        case 'W': words = val; break;
+        case 'e': exit_threshold = (float)atof(val); break;
+        case 'E': exit_every = atoi(val); break;
+        case 'k':
+            for (kv_type = 0; kv_type < N_WEIGHT_TYPES; kv_type++) {
+                if (strcmp(val, weight_type_name(kv_type)) == 0) break;
+            }
+            if (kv_type == N_WEIGHT_TYPES) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (seed == 0) seed = (unsigned long long)time_us_64();
+    if (strlen(prompt) + 3 > MAX_SEQ_LEN) {
+        printf("Host: prompt longer than %d bytes\n", MAX_SEQ_LEN - 3);
+        return 1;
+    }
+
+    if (charset && constraint_charset(&constraint, charset) != 0) return 1;
+    if (words && constraint_words(&constraint, words) != 0) return 1;
+
+    if (session_path && n_extra > 0) {
+        printf("Host: -S works with a single model\n");
+        return 1;
+    }
+
+    if (psram_setup() != 0) return 1;
+
+    static unsigned char tok_data[MAX_VOCAB_SIZE * (MAX_TOKEN_LENGTH + 8) + 4];
+    long tok_size = read_file(tok_path, tok_data, sizeof(tok_data));
+    if (tok_size < 0) return 1;
+
+    const char *paths[MAX_MODELS];
+    paths[0] = model_path;
+    for (int i = 0; i < n_extra; i++) paths[i + 1] = extra[i];
+    for (int i = 0; i <= n_extra; i++) {
+        if (load_model(paths[i], tok_data, (unsigned int)tok_size) < 0) {
+            printf("Failed to load %s\n", paths[i]);
+            return 1;
+        }
+    }
+    printf("\n");
+    models_dump();
+    static char text[1 << 20];
+    if (score_path) {
+        long size = read_file(score_path, text, sizeof(text) - 1);
+        if (size < 0) return 1;
+        text[size] = '\0';
+    }
+    if (session_path) {
+        return run_session(session_path, kv_type, temperature, topp, seed,
+                           prompt, steps);
+    }
+
+    for (int i = 0; i < model_count(); i++) {
+        Model *m = model_use(i);
+        int vocab = m->transformer.config.vocab_size;
+        m->transformer.early_exit.threshold = exit_threshold;
+        m->transformer.early_exit.every = exit_every;
+        init_sampler(&sampler, vocab, temperature, topp, seed);
+
+        if (score_path) {
+            printf("\n=== Scoring %s with %s ===\n\n", score_path, m->name);
+            if (score_file(m, text, stride) != 0) return 1;
+            continue;
+        }
+        printf("\n=== Generating with %s ===\n\n", m->name);
+        if (charset || words) {
+            static GenContext ctx;
+            if (constraint_compile(&constraint, m->tokenizer, vocab) != 0 ||
+                gen_init(&ctx, &m->transformer, m->tokenizer, &sampler,
+                         prompt, steps, stream) != 0) {
+                return 1;
+            }
+            gen_constrain(&ctx, &constraint);
+            generate_print(&ctx, NULL);
+        } else if (beam_width > 0) {
+            generate_beam(&m->transformer, m->tokenizer, prompt, beam_width,
+                          steps);
+        } else if (stream) {
+            generate_stream(&m->transformer, m->tokenizer, &sampler, prompt,
+                            steps);
+        } else {
+            generate(&m->transformer, m->tokenizer, &sampler, prompt, steps);
+        }
+    }
+    return 0;
+}
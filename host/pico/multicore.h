@@ -0,0 +1,27 @@
+/* pico/multicore.h - host stand-in for launching work on core1 */
+
+#ifndef HOST_PICO_MULTICORE_H
+#define HOST_PICO_MULTICORE_H
+
+#include <pthread.h>
+
+static void (*host_core1_fn)(void);
+
+static inline void *host_core1_entry(void *arg) {
+    (void)arg;
+    host_core1_fn();
+    return NULL;
+}
+
+/* Nothing to reset: every launch gets a fresh detached thread */
+static inline void multicore_reset_core1(void) {
+}
+
+static inline void multicore_launch_core1(void (*entry)(void)) {
+    pthread_t thread;
+    host_core1_fn = entry;
+    pthread_create(&thread, NULL, host_core1_entry, NULL);
+    pthread_detach(thread);
+}
+
+#endif /* HOST_PICO_MULTICORE_H */
@@ -0,0 +1,29 @@
+/* psram_host.c - heap-backed PSRAM window for host builds */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "psram.h"
+
+uint8_t *psram_host_base = NULL;
+
+int psram_setup(void)
+{
+    if (psram_host_base) return 0;
+    psram_host_base = aligned_alloc(64, PSRAM_WINDOW_SIZE);
+    if (!psram_host_base) {
+        printf("PSRAM: host allocation of %u bytes failed\n",
+               (unsigned)PSRAM_WINDOW_SIZE);
+        return -1;
+    }
+    return 0;
+}
+
+size_t psram_size(void)
+{
+    return psram_host_base ? PSRAM_WINDOW_SIZE : 0;
+}
+
+const psram_id_t *psram_get_id(void)
+{
+    return NULL;
+}
@@ -0,0 +1,359 @@
+#include "kernels.h"
+#include "half.h"
+#include "fastmath.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* ---- Scalar backend ---- */
+
+static void matmul_f32(float *xout, const float *x, const float *w,
+                       int n, int d) {
+    for (int i = 0; i < d; i++) {
+        float val = 0.0f;
+        for (int j = 0; j < n; j++) {
+            val += w[i * n + j] * x[j];
+        }
+        xout[i] = val;
+    }
+}
+
+static void matmul_f16(float *xout, const float *x, const uint16_t *w,
+                       int n, int d) {
+    for (int i = 0; i < d; i++) {
+        const uint16_t *row = w + i * n;
+        float val = 0.0f;
+        for (int j = 0; j < n; j++) {
+            val += f16_to_f32(row[j]) * x[j];
+        }
+        xout[i] = val;
+    }
+}
+
+static void matmul_bf16(float *xout, const float *x, const uint16_t *w,
+                        int n, int d) {
+    for (int i = 0; i < d; i++) {
+        const uint16_t *row = w + i * n;
+        float val = 0.0f;
+        for (int j = 0; j < n; j++) {
+            val += bf16_to_f32(row[j]) * x[j];
+        }
+        xout[i] = val;
+    }
+}
+
+/*
+ * Nibbles are widened straight to float and summed against x per group;
+ * the group scale is applied once per 32 MACs.
+ */
+static void matmul_q4(float *xout, const float *x, const BlockQ4 *w,
+                      int n, int d) {
+    int groups = n / Q4_GROUP_SIZE;
+    for (int i = 0; i < d; i++) {
+        const BlockQ4 *b = w + i * groups;
+        float val = 0.0f;
+        for (int g = 0; g < groups; g++, b++) {
+            const float *xg = x + g * Q4_GROUP_SIZE;
+            float acc = 0.0f;
+            for (int k = 0; k < Q4_GROUP_SIZE / 2; k++) {
+                uint8_t q = b->qs[k];
+                acc += ((q & 0x0f) - 8) * xg[2 * k];
+                acc += ((q >> 4) - 8) * xg[2 * k + 1];
+            }
+            val += acc * f16_to_f32(b->scale);
+        }
+        xout[i] = val;
+    }
+}
+
+static void matmul_q8(float *xout, const float *x, const BlockQ8 *w,
+                      int n, int d) {
+    int groups = n / Q8_GROUP_SIZE;
+    for (int i = 0; i < d; i++) {
+        const BlockQ8 *b = w + i * groups;
+        float val = 0.0f;
+        for (int g = 0; g < groups; g++, b++) {
+            const float *xg = x + g * Q8_GROUP_SIZE;
+            float acc = 0.0f;
+            for (int k = 0; k < Q8_GROUP_SIZE; k++) {
+                acc += b->qs[k] * xg[k];
+            }
+            val += acc * f16_to_f32(b->scale);
+        }
+        xout[i] = val;
+    }
+}
+
+/* Only the kept half of each run of 4 is read; zero groups are skipped */
+static void matmul_s8(float *xout, const float *x, const BlockS8 *w,
+                      int n, int d) {
+    int groups = n / S8_GROUP_SIZE;
+    for (int i = 0; i < d; i++) {
+        const BlockS8 *b = w + i * groups;
+        float val = 0.0f;
+        for (int g = 0; g < groups; g++, b++) {
+            if (b->scale == 0) continue;
+            const float *xg = x + g * S8_GROUP_SIZE;
+            float acc = 0.0f;
+            for (int j = 0; j < S8_GROUP_SIZE / 2; j++) {
+                int k = (b->idx[j / 4] >> (2 * (j % 4))) & 3;
+                acc += b->qs[j] * xg[4 * (j / 2) + k];
+            }
+            val += acc * f16_to_f32(b->scale);
+        }
+        xout[i] = val;
+    }
+}
+
+static void rmsnorm(float *o, const float *x, const float *weight, int size) {
+    float ss = 0.0f;
+    for (int j = 0; j < size; j++) {
+        ss += x[j] * x[j];
+    }
+    ss /= size;
+    ss += 1e-5f;
+    ss = 1.0f / sqrtf(ss);
+    for (int j = 0; j < size; j++) {
+        o[j] = weight[j] * (ss * x[j]);
+    }
+}
+
+static void softmax(float *x, int size) {
+    float max_val = x[0];
+    for (int i = 1; i < size; i++) {
+        if (x[i] > max_val) max_val = x[i];
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        x[i] = expf(x[i] - max_val);
+        sum += x[i];
+    }
+    for (int i = 0; i < size; i++) {
+        x[i] /= sum;
+    }
+}
+
+static void swiglu(float *hb, const float *hb2, int n) {
+    for (int i = 0; i < n; i++) {
+        float v = hb[i];
+        v *= (1.0f / (1.0f + expf(-v)));
+        v *= hb2[i];
+        hb[i] = v;
+    }
+}
+
+static void attn_scores(float *att, const float *q, const float *k,
+                        int stride, int n, int head_size) {
+    for (int t = 0; t < n; t++) {
+        const float *kt = k + t * stride;
+        float score = 0.0f;
+        for (int i = 0; i < head_size; i++) {
+            score += q[i] * kt[i];
+        }
+        score /= sqrtf(head_size);
+        att[t] = score;
+    }
+}
+
+static void attn_mix(float *out, const float *att, const float *v,
+                     int stride, int n, int head_size) {
+    memset(out, 0, head_size * sizeof(float));
+    for (int t = 0; t < n; t++) {
+        const float *vt = v + t * stride;
+        float a = att[t];
+        for (int i = 0; i < head_size; i++) {
+            out[i] += a * vt[i];
+        }
+    }
+}
+
+const Kernels kernels_scalar = {
+    "scalar",
+    matmul_f32, matmul_f16, matmul_bf16, matmul_q4, matmul_q8, matmul_s8,
+    rmsnorm, softmax, swiglu, attn_scores, attn_mix,
+};
+
+/* ---- Scalar backend, fast math ---- */
+
+static void rmsnorm_fast(float *o, const float *x, const float *weight,
+                         int size) {
+    float ss = 0.0f;
+    for (int j = 0; j < size; j++) {
+        ss += x[j] * x[j];
+    }
+    ss = fast_rsqrtf(ss / size + 1e-5f);
+    for (int j = 0; j < size; j++) {
+        o[j] = weight[j] * (ss * x[j]);
+    }
+}
+
+static void softmax_fast(float *x, int size) {
+    float max_val = x[0];
+    for (int i = 1; i < size; i++) {
+        if (x[i] > max_val) max_val = x[i];
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        x[i] = fast_expf(x[i] - max_val);
+        sum += x[i];
+    }
+    float inv = 1.0f / sum;
+    for (int i = 0; i < size; i++) {
+        x[i] *= inv;
+    }
+}
+
+static void swiglu_fast(float *hb, const float *hb2, int n) {
+    for (int i = 0; i < n; i++) {
+        hb[i] = fast_silu(hb[i]) * hb2[i];
+    }
+}
+
+const Kernels kernels_fast = {
+    "scalar-fast",
+    matmul_f32, matmul_f16, matmul_bf16, matmul_q4, matmul_q8, matmul_s8,
+    rmsnorm_fast, softmax_fast, swiglu_fast, attn_scores, attn_mix,
+};
+
+#if USE_FAST_MATH
+#define KERNELS_DEFAULT (&kernels_fast)
+#else
+#define KERNELS_DEFAULT (&kernels_scalar)
+#endif
+
+const Kernels *kernels = KERNELS_DEFAULT;
+
+/* ---- Backend selection ---- */
+
+#ifdef PICO_LLAMA_HOST
+
+#include <stdlib.h>
+
+#define CHECK_MAX_N 256
+#define CHECK_MAX_D 32
+
+static float ck_x[CHECK_MAX_N], ck_w[CHECK_MAX_D * CHECK_MAX_N];
+static uint16_t ck_h[CHECK_MAX_D * CHECK_MAX_N];
+static BlockQ4 ck_q4[CHECK_MAX_D * CHECK_MAX_N / Q4_GROUP_SIZE];
+static BlockQ8 ck_q8[CHECK_MAX_D * CHECK_MAX_N / Q8_GROUP_SIZE];
+static BlockS8 ck_s8[CHECK_MAX_D * CHECK_MAX_N / S8_GROUP_SIZE];
+static float ck_kv[CHECK_MAX_N * CHECK_MAX_N];
+static float ck_ref[CHECK_MAX_N], ck_out[CHECK_MAX_N];
+
+static float check_rand(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return (float)(*state >> 8) / (float)(1u << 23) - 1.0f;   /* [-1, 1) */
+}
+
+/* Worst error relative to the largest reference magnitude */
+static float rel_diff(const float *ref, const float *got, int n) {
+    float max_diff = 0.0f, max_ref = 1e-30f;
+    for (int i = 0; i < n; i++) {
+        float d = fabsf(ref[i] - got[i]);
+        if (isnan(d)) return INFINITY;
+        if (d > max_diff) max_diff = d;
+        if (fabsf(ref[i]) > max_ref) max_ref = fabsf(ref[i]);
+    }
+    return max_diff / max_ref;
+}
+
+float kernels_check(const Kernels *k, int n, int d, int t, int head_size) {
+    const Kernels *s = &kernels_scalar;
+    if (n < Q4_GROUP_SIZE || n > CHECK_MAX_N || n % Q4_GROUP_SIZE ||
+        d < 1 || d > CHECK_MAX_D || t < 1 || t > n ||
+        head_size < 1 || head_size > n) {
+        return INFINITY;
+    }
+    uint32_t seed = 12345;
+    for (int i = 0; i < n; i++) ck_x[i] = check_rand(&seed);
+    for (int i = 0; i < d * n; i++) ck_w[i] = check_rand(&seed);
+    for (int i = 0; i < t * n; i++) ck_kv[i] = check_rand(&seed);
+    float worst = 0.0f, e;
+
+#define CHECK(call_ref, call_got, len) do {                         \
+        call_ref; call_got;                                         \
+        e = rel_diff(ck_ref, ck_out, len);                          \
+        if (e > worst) worst = e;                                   \
+    } while (0)
+
+    CHECK(s->matmul_f32(ck_ref, ck_x, ck_w, n, d),
+          k->matmul_f32(ck_out, ck_x, ck_w, n, d), d);
+
+    weight_convert(ck_h, ck_w, d * n, WEIGHT_F16, NULL);
+    CHECK(s->matmul_f16(ck_ref, ck_x, ck_h, n, d),
+          k->matmul_f16(ck_out, ck_x, ck_h, n, d), d);
+
+    weight_convert(ck_h, ck_w, d * n, WEIGHT_BF16, NULL);
+    CHECK(s->matmul_bf16(ck_ref, ck_x, ck_h, n, d),
+          k->matmul_bf16(ck_out, ck_x, ck_h, n, d), d);
+
+    weight_convert(ck_q4, ck_w, d * n, WEIGHT_Q4, NULL);
+    CHECK(s->matmul_q4(ck_ref, ck_x, ck_q4, n, d),
+          k->matmul_q4(ck_out, ck_x, ck_q4, n, d), d);
+
+    weight_convert(ck_q8, ck_w, d * n, WEIGHT_Q8, NULL);
+    CHECK(s->matmul_q8(ck_ref, ck_x, ck_q8, n, d),
+          k->matmul_q8(ck_out, ck_x, ck_q8, n, d), d);
+
+    weight_convert(ck_s8, ck_w, d * n, WEIGHT_S8, NULL);
+    ck_s8[d * n / S8_GROUP_SIZE / 2].scale = 0;     /* a block-pruned group */
+    CHECK(s->matmul_s8(ck_ref, ck_x, ck_s8, n, d),
+          k->matmul_s8(ck_out, ck_x, ck_s8, n, d), d);
+
+    /* n - 1 so the elementwise kernels hit their SIMD tails */
+    CHECK(s->rmsnorm(ck_ref, ck_x, ck_w, n - 1),
+          k->rmsnorm(ck_out, ck_x, ck_w, n - 1), n - 1);
+
+    memcpy(ck_ref, ck_x, n * sizeof(float));
+    memcpy(ck_out, ck_x, n * sizeof(float));
+    CHECK(s->softmax(ck_ref, t), k->softmax(ck_out, t), t);
+
+    memcpy(ck_ref, ck_x, n * sizeof(float));
+    memcpy(ck_out, ck_x, n * sizeof(float));
+    CHECK(s->swiglu(ck_ref, ck_w, n - 1),
+          k->swiglu(ck_out, ck_w, n - 1), n - 1);
+
+    CHECK(s->attn_scores(ck_ref, ck_x, ck_kv, n, t, head_size),
+          k->attn_scores(ck_out, ck_x, ck_kv, n, t, head_size), t);
+
+    CHECK(s->attn_mix(ck_ref, ck_x, ck_kv, n, t, head_size),
+          k->attn_mix(ck_out, ck_x, ck_kv, n, t, head_size), head_size);
+
+#undef CHECK
+    return worst;
+}
+
+/* PICO_LLAMA_KERNELS=<name> in the environment forces a backend */
+void kernels_init(void) {
+    const Kernels *candidates[] = { kernels_avx2(), kernels_neon() };
+    const char *force = getenv("PICO_LLAMA_KERNELS");
+    kernels = KERNELS_DEFAULT;
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        const Kernels *k = candidates[i];
+        if (!k) continue;
+        if (force && strcmp(force, k->name) != 0) continue;
+        float err = kernels_check(k, KERNELS_CHECK_SHAPE);
+        if (err > KERNELS_CHECK_TOLERANCE) {
+            printf("Kernels: %s disagrees with scalar (rel err %.2e), "
+                   "not used\n", k->name, (double)err);
+            continue;
+        }
+        printf("Kernels: %s (rel err vs scalar %.2e)\n", k->name, (double)err);
+        kernels = k;
+        return;
+    }
+    if (force && strcmp(force, kernels_scalar.name) == 0) {
+        kernels = &kernels_scalar;
+    } else if (force && strcmp(force, kernels_fast.name) == 0) {
+        kernels = &kernels_fast;
+    }
+    printf("Kernels: %s\n", kernels->name);
+}
+
+#else
+
+void kernels_init(void) {
+    kernels = KERNELS_DEFAULT;
+}
+
+#endif /* PICO_LLAMA_HOST */
@@ -0,0 +1,83 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stdint.h>
+#include "weights.h"
+
+/*
+ * Compute kernels behind the forward pass. The portable scalar backend is
+ * what runs on the Pico; host builds add AVX2/FMA (x86-64) and NEON
+ * (aarch64, with PICO_LLAMA_NEON) backends, chosen at runtime by
+ * kernels_init(). Every backend
+ * must match the scalar one within float rounding.
+ */
+typedef struct {
+    const char *name;
+
+    /* xout[d] = W[d][n] @ x[n] for each weight storage format */
+    void (*matmul_f32)(float *xout, const float *x, const float *w,
+                       int n, int d);
+    void (*matmul_f16)(float *xout, const float *x, const uint16_t *w,
+                       int n, int d);
+    void (*matmul_bf16)(float *xout, const float *x, const uint16_t *w,
+                        int n, int d);
+    void (*matmul_q4)(float *xout, const float *x, const BlockQ4 *w,
+                      int n, int d);
+    void (*matmul_q8)(float *xout, const float *x, const BlockQ8 *w,
+                      int n, int d);
+    void (*matmul_s8)(float *xout, const float *x, const BlockS8 *w,
+                      int n, int d);
+
+    void (*rmsnorm)(float *o, const float *x, const float *weight, int size);
+    void (*softmax)(float *x, int size);
+    /* hb[i] = silu(hb[i]) * hb2[i] */
+    void (*swiglu)(float *hb, const float *hb2, int n);
+
+    /* att[t] = q . k_t / sqrt(head_size), k_t = k + t * stride */
+    void (*attn_scores)(float *att, const float *q, const float *k,
+                        int stride, int n, int head_size);
+    /* out = sum_t att[t] * v_t, v_t = v + t * stride */
+    void (*attn_mix)(float *out, const float *att, const float *v,
+                     int stride, int n, int head_size);
+} Kernels;
+
+/* Active backend; the scalar one until kernels_init() runs */
+extern const Kernels *kernels;
+
+/* Exact libm softmax/rmsnorm/SiLU */
+extern const Kernels kernels_scalar;
+
+/* Same matmuls, with the fastmath.h approximations (USE_FAST_MATH) */
+extern const Kernels kernels_fast;
+
+/* SIMD backends, or NULL when not built in or not supported by the CPU */
+const Kernels *kernels_avx2(void);
+const Kernels *kernels_neon(void);
+
+/**
+ * Pick the fastest backend the CPU supports, check it against the scalar
+ * backend on synthetic data, and fall back to scalar if it disagrees.
+ * The scalar fallback is kernels_fast when built with USE_FAST_MATH.
+ */
+void kernels_init(void);
+
+#ifdef PICO_LLAMA_HOST
+/*
+ * Self-check against scalar. The startup shape has odd lengths to cover
+ * the SIMD tails and a matmul width of whole quantisation groups.
+ */
+#define KERNELS_CHECK_SHAPE     96, 13, 37, 19
+#define KERNELS_CHECK_TOLERANCE 1e-4f
+
+/**
+ * Worst relative error of k against the scalar backend over every kernel
+ * on synthetic data: d x n matmuls in each weight format, the elementwise
+ * kernels over n - 1 values, softmax and attention over t positions of
+ * head_size. n must be a multiple of 32 up to 256, d at most 32 and t and
+ * head_size at most n; INFINITY otherwise. tools/kernelcheck.c runs it
+ * over several shapes.
+ */
+float kernels_check(const Kernels *k, int n, int d, int t, int head_size);
+#endif
+
+#endif /* KERNELS_H */
@@ -0,0 +1,351 @@
+/* kernels_avx2.c - AVX2/FMA/F16C kernels for x86-64 host builds
+ *
+ * Compiled without -mavx2: each function carries its own target attribute
+ * so the binary still starts on older CPUs, and kernels_avx2() only hands
+ * the table out when the CPU reports all three extensions. */
+
+#include "kernels.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+#include <immintrin.h>
+#include <math.h>
+#include <string.h>
+#include "fastmath.h"
+
+#define AVX2 __attribute__((target("avx2,fma,f16c")))
+
+AVX2 static inline float hsum(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v),
+                           _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+
+/* fast_expf() eight lanes at a time (round-to-even instead of away) */
+AVX2 static inline __m256 exp8(__m256 x) {
+    __m256 xc = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(FAST_EXP_LO)),
+                              _mm256_set1_ps(FAST_EXP_HI));
+    __m256 fn = _mm256_round_ps(_mm256_mul_ps(xc, _mm256_set1_ps(FAST_LOG2E)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(FAST_LN2_HI), xc);
+    r = _mm256_fnmadd_ps(fn, _mm256_set1_ps(FAST_LN2_LO), r);
+    __m256 p = _mm256_set1_ps(FAST_EXP_P0);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(FAST_EXP_P1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(FAST_EXP_P2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(FAST_EXP_P3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(FAST_EXP_P4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(FAST_EXP_P5));
+    p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r,
+                        _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    __m256i e = _mm256_slli_epi32(
+        _mm256_add_epi32(_mm256_cvtps_epi32(fn), _mm256_set1_epi32(127)), 23);
+    __m256 res = _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+    return _mm256_andnot_ps(
+        _mm256_cmp_ps(x, _mm256_set1_ps(FAST_EXP_LO), _CMP_LT_OQ), res);
+}
+
+/* Dot product of n floats, two accumulators to hide FMA latency */
+AVX2 static inline float dot(const float *a, const float *b, int n) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j),
+                               _mm256_loadu_ps(b + j), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j + 8),
+                               _mm256_loadu_ps(b + j + 8), acc1);
+    }
+    for (; j + 8 <= n; j += 8) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + j),
+                               _mm256_loadu_ps(b + j), acc0);
+    }
+    float val = hsum(_mm256_add_ps(acc0, acc1));
+    for (; j < n; j++) val += a[j] * b[j];
+    return val;
+}
+
+AVX2 static void matmul_f32(float *xout, const float *x, const float *w,
+                            int n, int d) {
+    for (int i = 0; i < d; i++) {
+        xout[i] = dot(w + (size_t)i * n, x, n);
+    }
+}
+
+AVX2 static void matmul_f16(float *xout, const float *x, const uint16_t *w,
+                            int n, int d) {
+    for (int i = 0; i < d; i++) {
+        const uint16_t *row = w + (size_t)i * n;
+        __m256 acc = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256 wf = _mm256_cvtph_ps(
+                _mm_loadu_si128((const __m128i *)(row + j)));
+            acc = _mm256_fmadd_ps(wf, _mm256_loadu_ps(x + j), acc);
+        }
+        float val = hsum(acc);
+        for (; j < n; j++) {
+            __m128 h = _mm_cvtph_ps(_mm_cvtsi32_si128(row[j]));
+            val += _mm_cvtss_f32(h) * x[j];
+        }
+        xout[i] = val;
+    }
+}
+
+AVX2 static void matmul_bf16(float *xout, const float *x, const uint16_t *w,
+                             int n, int d) {
+    for (int i = 0; i < d; i++) {
+        const uint16_t *row = w + (size_t)i * n;
+        __m256 acc = _mm256_setzero_ps();
+        int j = 0;
+        for (; j + 8 <= n; j += 8) {
+            __m256i h = _mm256_cvtepu16_epi32(
+                _mm_loadu_si128((const __m128i *)(row + j)));
+            __m256 wf = _mm256_castsi256_ps(_mm256_slli_epi32(h, 16));
+            acc = _mm256_fmadd_ps(wf, _mm256_loadu_ps(x + j), acc);
+        }
+        float val = hsum(acc);
+        for (; j < n; j++) {
+            uint32_t bits = (uint32_t)row[j] << 16;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            val += f * x[j];
+        }
+        xout[i] = val;
+    }
+}
+
+/* Eight int8 lanes (the low half of b) widened to float */
+AVX2 static inline __m256 widen8(__m128i b) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b));
+}
+
+/* 32 int8 weights in b0:b1 against one group of x */
+AVX2 static inline __m256 group_dot(__m128i b0, __m128i b1, const float *x) {
+    __m256 acc = _mm256_mul_ps(widen8(b0), _mm256_loadu_ps(x));
+    acc = _mm256_fmadd_ps(widen8(_mm_srli_si128(b0, 8)),
+                          _mm256_loadu_ps(x + 8), acc);
+    acc = _mm256_fmadd_ps(widen8(b1), _mm256_loadu_ps(x + 16), acc);
+    acc = _mm256_fmadd_ps(widen8(_mm_srli_si128(b1, 8)),
+                          _mm256_loadu_ps(x + 24), acc);
+    return acc;
+}
+
+/* Per-group sums stay in lanes; the fp16 scale is broadcast per group */
+AVX2 static void matmul_q4(float *xout, const float *x, const BlockQ4 *w,
+                           int n, int d) {
+    int groups = n / Q4_GROUP_SIZE;
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i eight = _mm_set1_epi8(8);
+    for (int i = 0; i < d; i++) {
+        const BlockQ4 *b = w + (size_t)i * groups;
+        __m256 acc = _mm256_setzero_ps();
+        for (int g = 0; g < groups; g++, b++) {
+            __m128i q = _mm_loadu_si128((const __m128i *)b->qs);
+            __m128i lo = _mm_and_si128(q, mask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(q, 4), mask);
+            /* Element 2k is the low nibble of byte k, 2k+1 the high one */
+            __m128i e0 = _mm_sub_epi8(_mm_unpacklo_epi8(lo, hi), eight);
+            __m128i e1 = _mm_sub_epi8(_mm_unpackhi_epi8(lo, hi), eight);
+            __m256 scale = _mm256_set1_ps(
+                _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(b->scale))));
+            acc = _mm256_fmadd_ps(group_dot(e0, e1, x + g * Q4_GROUP_SIZE),
+                                  scale, acc);
+        }
+        xout[i] = hsum(acc);
+    }
+}
+
+AVX2 static void matmul_q8(float *xout, const float *x, const BlockQ8 *w,
+                           int n, int d) {
+    int groups = n / Q8_GROUP_SIZE;
+    for (int i = 0; i < d; i++) {
+        const BlockQ8 *b = w + (size_t)i * groups;
+        __m256 acc = _mm256_setzero_ps();
+        for (int g = 0; g < groups; g++, b++) {
+            __m128i e0 = _mm_loadu_si128((const __m128i *)b->qs);
+            __m128i e1 = _mm_loadu_si128((const __m128i *)(b->qs + 16));
+            __m256 scale = _mm256_set1_ps(
+                _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(b->scale))));
+            acc = _mm256_fmadd_ps(group_dot(e0, e1, x + g * Q8_GROUP_SIZE),
+                                  scale, acc);
+        }
+        xout[i] = hsum(acc);
+    }
+}
+
+/*
+ * The kept values' x elements are gathered by index: eight 2-bit
+ * positions come from 16 bits of idx, offset by the start of their run.
+ */
+AVX2 static void matmul_s8(float *xout, const float *x, const BlockS8 *w,
+                           int n, int d) {
+    int groups = n / S8_GROUP_SIZE;
+    const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i runs = _mm256_setr_epi32(0, 0, 4, 4, 8, 8, 12, 12);
+    const __m256i three = _mm256_set1_epi32(3);
+    for (int i = 0; i < d; i++) {
+        const BlockS8 *b = w + (size_t)i * groups;
+        __m256 acc = _mm256_setzero_ps();
+        for (int g = 0; g < groups; g++, b++) {
+            if (b->scale == 0) continue;
+            const float *xg = x + g * S8_GROUP_SIZE;
+            uint16_t lo, hi;
+            memcpy(&lo, b->idx, sizeof(lo));
+            memcpy(&hi, b->idx + 2, sizeof(hi));
+            __m256i k0 = _mm256_and_si256(
+                _mm256_srlv_epi32(_mm256_set1_epi32(lo), shifts), three);
+            __m256i k1 = _mm256_and_si256(
+                _mm256_srlv_epi32(_mm256_set1_epi32(hi), shifts), three);
+            __m256 x0 = _mm256_i32gather_ps(xg, _mm256_add_epi32(runs, k0), 4);
+            __m256 x1 = _mm256_i32gather_ps(xg + 16,
+                                            _mm256_add_epi32(runs, k1), 4);
+            __m128i q = _mm_loadu_si128((const __m128i *)b->qs);
+            __m256 gacc = _mm256_mul_ps(widen8(q), x0);
+            gacc = _mm256_fmadd_ps(widen8(_mm_srli_si128(q, 8)), x1, gacc);
+            __m256 scale = _mm256_set1_ps(
+                _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(b->scale))));
+            acc = _mm256_fmadd_ps(gacc, scale, acc);
+        }
+        xout[i] = hsum(acc);
+    }
+}
+
+AVX2 static void rmsnorm(float *o, const float *x, const float *weight,
+                         int size) {
+    float ss = dot(x, x, size);
+#if USE_FAST_MATH
+    ss = fast_rsqrtf(ss / size + 1e-5f);
+#else
+    ss /= size;
+    ss += 1e-5f;
+    ss = 1.0f / sqrtf(ss);
+#endif
+    __m256 vs = _mm256_set1_ps(ss);
+    int j = 0;
+    for (; j + 8 <= size; j += 8) {
+        __m256 v = _mm256_mul_ps(vs, _mm256_loadu_ps(x + j));
+        _mm256_storeu_ps(o + j, _mm256_mul_ps(_mm256_loadu_ps(weight + j), v));
+    }
+    for (; j < size; j++) o[j] = weight[j] * (ss * x[j]);
+}
+
+/* Max and normalisation are vectorised; exp too with USE_FAST_MATH */
+AVX2 static void softmax(float *x, int size) {
+    float max_val = x[0];
+    int i = 0;
+    if (size >= 8) {
+        __m256 vmax = _mm256_loadu_ps(x);
+        for (i = 8; i + 8 <= size; i += 8) {
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(x + i));
+        }
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(vmax),
+                              _mm256_extractf128_ps(vmax, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        max_val = _mm_cvtss_f32(m);
+    }
+    for (; i < size; i++) {
+        if (x[i] > max_val) max_val = x[i];
+    }
+#if USE_FAST_MATH
+    __m256 vmax = _mm256_set1_ps(max_val), vacc = _mm256_setzero_ps();
+    for (i = 0; i + 8 <= size; i += 8) {
+        __m256 e = exp8(_mm256_sub_ps(_mm256_loadu_ps(x + i), vmax));
+        _mm256_storeu_ps(x + i, e);
+        vacc = _mm256_add_ps(vacc, e);
+    }
+    float sum = hsum(vacc);
+    for (; i < size; i++) {
+        x[i] = fast_expf(x[i] - max_val);
+        sum += x[i];
+    }
+    float inv = 1.0f / sum;
+    __m256 vinv = _mm256_set1_ps(inv);
+    for (i = 0; i + 8 <= size; i += 8) {
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), vinv));
+    }
+    for (; i < size; i++) x[i] *= inv;
+#else
+    float sum = 0.0f;
+    for (i = 0; i < size; i++) {
+        x[i] = expf(x[i] - max_val);
+        sum += x[i];
+    }
+    __m256 vsum = _mm256_set1_ps(sum);
+    for (i = 0; i + 8 <= size; i += 8) {
+        _mm256_storeu_ps(x + i, _mm256_div_ps(_mm256_loadu_ps(x + i), vsum));
+    }
+    for (; i < size; i++) x[i] /= sum;
+#endif
+}
+
+AVX2 static void swiglu(float *hb, const float *hb2, int n) {
+    int i = 0;
+#if USE_FAST_MATH
+    const __m256 one = _mm256_set1_ps(1.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps(hb + i);
+        __m256 e = exp8(_mm256_sub_ps(_mm256_setzero_ps(), v));
+        __m256 silu = _mm256_div_ps(v, _mm256_add_ps(one, e));
+        _mm256_storeu_ps(hb + i, _mm256_mul_ps(silu, _mm256_loadu_ps(hb2 + i)));
+    }
+    for (; i < n; i++) hb[i] = fast_silu(hb[i]) * hb2[i];
+#else
+    for (; i < n; i++) {
+        float v = hb[i];
+        v *= (1.0f / (1.0f + expf(-v)));
+        hb[i] = v * hb2[i];
+    }
+#endif
+}
+
+AVX2 static void attn_scores(float *att, const float *q, const float *k,
+                             int stride, int n, int head_size) {
+    float scale = sqrtf(head_size);
+    for (int t = 0; t < n; t++) {
+        att[t] = dot(q, k + (size_t)t * stride, head_size) / scale;
+    }
+}
+
+AVX2 static void attn_mix(float *out, const float *att, const float *v,
+                          int stride, int n, int head_size) {
+    int i = 0;
+    for (; i + 8 <= head_size; i += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (int t = 0; t < n; t++) {
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(att[t]),
+                                  _mm256_loadu_ps(v + (size_t)t * stride + i),
+                                  acc);
+        }
+        _mm256_storeu_ps(out + i, acc);
+    }
+    for (; i < head_size; i++) {
+        float acc = 0.0f;
+        for (int t = 0; t < n; t++) acc += att[t] * v[(size_t)t * stride + i];
+        out[i] = acc;
+    }
+}
+
+static const Kernels avx2_kernels = {
+    "avx2",
+    matmul_f32, matmul_f16, matmul_bf16, matmul_q4, matmul_q8, matmul_s8,
+    rmsnorm, softmax, swiglu, attn_scores, attn_mix,
+};
+
+const Kernels *kernels_avx2(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+        __builtin_cpu_supports("f16c")) {
+        return &avx2_kernels;
+    }
+    return NULL;
+}
+
+#else
+
+const Kernels *kernels_avx2(void) {
+    return NULL;
+}
+
+#endif
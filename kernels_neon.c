@@ -0,0 +1,296 @@
+/* kernels_neon.c - Advanced SIMD kernels for aarch64 host builds
+ *
+ * NEON is mandatory on aarch64, so the table is always available there
+ * (Raspberry Pi 4/5, Apple silicon under Linux). Opt-in with
+ * -DPICO_LLAMA_NEON=ON until it has been built and run on aarch64:
+ * kernelcheck against scalar, then bench's golden-logit compare with
+ * PICO_LLAMA_KERNELS=neon. */
+
+#include "kernels.h"
+
+#if defined(__aarch64__) && defined(PICO_LLAMA_NEON)
+
+#include <arm_neon.h>
+#include <math.h>
+#include <string.h>
+#include "fastmath.h"
+
+/* fast_expf() four lanes at a time (round-to-even instead of away) */
+static inline float32x4_t exp4(float32x4_t x) {
+    float32x4_t xc = vminq_f32(vmaxq_f32(x, vdupq_n_f32(FAST_EXP_LO)),
+                               vdupq_n_f32(FAST_EXP_HI));
+    float32x4_t fn = vrndnq_f32(vmulq_n_f32(xc, FAST_LOG2E));
+    float32x4_t r = vfmsq_f32(xc, fn, vdupq_n_f32(FAST_LN2_HI));
+    r = vfmsq_f32(r, fn, vdupq_n_f32(FAST_LN2_LO));
+    float32x4_t p = vdupq_n_f32(FAST_EXP_P0);
+    p = vfmaq_f32(vdupq_n_f32(FAST_EXP_P1), p, r);
+    p = vfmaq_f32(vdupq_n_f32(FAST_EXP_P2), p, r);
+    p = vfmaq_f32(vdupq_n_f32(FAST_EXP_P3), p, r);
+    p = vfmaq_f32(vdupq_n_f32(FAST_EXP_P4), p, r);
+    p = vfmaq_f32(vdupq_n_f32(FAST_EXP_P5), p, r);
+    p = vfmaq_f32(vaddq_f32(r, vdupq_n_f32(1.0f)), vmulq_f32(p, r), r);
+    int32x4_t e = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(fn), vdupq_n_s32(127)), 23);
+    float32x4_t res = vmulq_f32(p, vreinterpretq_f32_s32(e));
+    uint32x4_t under = vcltq_f32(x, vdupq_n_f32(FAST_EXP_LO));
+    return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(res), under));
+}
+
+static inline float dot(const float *a, const float *b, int n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + j), vld1q_f32(b + j));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + j + 4), vld1q_f32(b + j + 4));
+    }
+    for (; j + 4 <= n; j += 4) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + j), vld1q_f32(b + j));
+    }
+    float val = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; j < n; j++) val += a[j] * b[j];
+    return val;
+}
+
+static inline float half_to_float(uint16_t h) {
+    return vgetq_lane_f32(vcvt_f32_f16(vreinterpret_f16_u16(vdup_n_u16(h))), 0);
+}
+
+static void matmul_f32(float *xout, const float *x, const float *w,
+                       int n, int d) {
+    for (int i = 0; i < d; i++) {
+        xout[i] = dot(w + (size_t)i * n, x, n);
+    }
+}
+
+static void matmul_f16(float *xout, const float *x, const uint16_t *w,
+                       int n, int d) {
+    for (int i = 0; i < d; i++) {
+        const uint16_t *row = w + (size_t)i * n;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            float32x4_t wf = vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(row + j)));
+            acc = vfmaq_f32(acc, wf, vld1q_f32(x + j));
+        }
+        float val = vaddvq_f32(acc);
+        for (; j < n; j++) val += half_to_float(row[j]) * x[j];
+        xout[i] = val;
+    }
+}
+
+static void matmul_bf16(float *xout, const float *x, const uint16_t *w,
+                        int n, int d) {
+    for (int i = 0; i < d; i++) {
+        const uint16_t *row = w + (size_t)i * n;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        int j = 0;
+        for (; j + 4 <= n; j += 4) {
+            float32x4_t wf = vreinterpretq_f32_u32(vshll_n_u16(vld1_u16(row + j), 16));
+            acc = vfmaq_f32(acc, wf, vld1q_f32(x + j));
+        }
+        float val = vaddvq_f32(acc);
+        for (; j < n; j++) {
+            uint32_t bits = (uint32_t)row[j] << 16;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            val += f * x[j];
+        }
+        xout[i] = val;
+    }
+}
+
+/* 16 int8 weights against 16 floats of x */
+static inline float32x4_t dot16(int8x16_t q, const float *x, float32x4_t acc) {
+    int16x8_t lo = vmovl_s8(vget_low_s8(q));
+    int16x8_t hi = vmovl_s8(vget_high_s8(q));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), vld1q_f32(x));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), vld1q_f32(x + 4));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), vld1q_f32(x + 8));
+    acc = vfmaq_f32(acc, vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), vld1q_f32(x + 12));
+    return acc;
+}
+
+static void matmul_q4(float *xout, const float *x, const BlockQ4 *w,
+                      int n, int d) {
+    int groups = n / Q4_GROUP_SIZE;
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    const int8x16_t eight = vdupq_n_s8(8);
+    for (int i = 0; i < d; i++) {
+        const BlockQ4 *b = w + (size_t)i * groups;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int g = 0; g < groups; g++, b++) {
+            const float *xg = x + g * Q4_GROUP_SIZE;
+            uint8x16_t q = vld1q_u8(b->qs);
+            uint8x16_t lo = vandq_u8(q, mask);
+            uint8x16_t hi = vshrq_n_u8(q, 4);
+            /* Element 2k is the low nibble of byte k, 2k+1 the high one */
+            int8x16_t e0 = vsubq_s8(vreinterpretq_s8_u8(vzip1q_u8(lo, hi)), eight);
+            int8x16_t e1 = vsubq_s8(vreinterpretq_s8_u8(vzip2q_u8(lo, hi)), eight);
+            float32x4_t gacc = dot16(e0, xg, vdupq_n_f32(0.0f));
+            gacc = dot16(e1, xg + 16, gacc);
+            acc = vfmaq_n_f32(acc, gacc, half_to_float(b->scale));
+        }
+        xout[i] = vaddvq_f32(acc);
+    }
+}
+
+static void matmul_q8(float *xout, const float *x, const BlockQ8 *w,
+                      int n, int d) {
+    int groups = n / Q8_GROUP_SIZE;
+    for (int i = 0; i < d; i++) {
+        const BlockQ8 *b = w + (size_t)i * groups;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int g = 0; g < groups; g++, b++) {
+            const float *xg = x + g * Q8_GROUP_SIZE;
+            float32x4_t gacc = dot16(vld1q_s8(b->qs), xg, vdupq_n_f32(0.0f));
+            gacc = dot16(vld1q_s8(b->qs + 16), xg + 16, gacc);
+            acc = vfmaq_n_f32(acc, gacc, half_to_float(b->scale));
+        }
+        xout[i] = vaddvq_f32(acc);
+    }
+}
+
+/* No gather on NEON: the kept values' x elements are picked out first */
+static void matmul_s8(float *xout, const float *x, const BlockS8 *w,
+                      int n, int d) {
+    int groups = n / S8_GROUP_SIZE;
+    float xk[S8_GROUP_SIZE / 2];
+    for (int i = 0; i < d; i++) {
+        const BlockS8 *b = w + (size_t)i * groups;
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int g = 0; g < groups; g++, b++) {
+            if (b->scale == 0) continue;
+            const float *xg = x + g * S8_GROUP_SIZE;
+            for (int j = 0; j < S8_GROUP_SIZE / 2; j++) {
+                int k = (b->idx[j / 4] >> (2 * (j % 4))) & 3;
+                xk[j] = xg[4 * (j / 2) + k];
+            }
+            float32x4_t gacc = dot16(vld1q_s8(b->qs), xk, vdupq_n_f32(0.0f));
+            acc = vfmaq_n_f32(acc, gacc, half_to_float(b->scale));
+        }
+        xout[i] = vaddvq_f32(acc);
+    }
+}
+
+static void rmsnorm(float *o, const float *x, const float *weight, int size) {
+    float ss = dot(x, x, size);
+#if USE_FAST_MATH
+    ss = fast_rsqrtf(ss / size + 1e-5f);
+#else
+    ss /= size;
+    ss += 1e-5f;
+    ss = 1.0f / sqrtf(ss);
+#endif
+    int j = 0;
+    for (; j + 4 <= size; j += 4) {
+        float32x4_t v = vmulq_n_f32(vld1q_f32(x + j), ss);
+        vst1q_f32(o + j, vmulq_f32(vld1q_f32(weight + j), v));
+    }
+    for (; j < size; j++) o[j] = weight[j] * (ss * x[j]);
+}
+
+/* Max and normalisation are vectorised; exp too with USE_FAST_MATH */
+static void softmax(float *x, int size) {
+    float max_val = x[0];
+    int i = 0;
+    if (size >= 4) {
+        float32x4_t vmax = vld1q_f32(x);
+        for (i = 4; i + 4 <= size; i += 4) {
+            vmax = vmaxq_f32(vmax, vld1q_f32(x + i));
+        }
+        max_val = vmaxvq_f32(vmax);
+    }
+    for (; i < size; i++) {
+        if (x[i] > max_val) max_val = x[i];
+    }
+#if USE_FAST_MATH
+    float32x4_t vmax = vdupq_n_f32(max_val), vacc = vdupq_n_f32(0.0f);
+    for (i = 0; i + 4 <= size; i += 4) {
+        float32x4_t e = exp4(vsubq_f32(vld1q_f32(x + i), vmax));
+        vst1q_f32(x + i, e);
+        vacc = vaddq_f32(vacc, e);
+    }
+    float sum = vaddvq_f32(vacc);
+    for (; i < size; i++) {
+        x[i] = fast_expf(x[i] - max_val);
+        sum += x[i];
+    }
+    float inv = 1.0f / sum;
+    for (i = 0; i + 4 <= size; i += 4) {
+        vst1q_f32(x + i, vmulq_n_f32(vld1q_f32(x + i), inv));
+    }
+    for (; i < size; i++) x[i] *= inv;
+#else
+    float sum = 0.0f;
+    for (i = 0; i < size; i++) {
+        x[i] = expf(x[i] - max_val);
+        sum += x[i];
+    }
+    float32x4_t vsum = vdupq_n_f32(sum);
+    for (i = 0; i + 4 <= size; i += 4) {
+        vst1q_f32(x + i, vdivq_f32(vld1q_f32(x + i), vsum));
+    }
+    for (; i < size; i++) x[i] /= sum;
+#endif
+}
+
+static void swiglu(float *hb, const float *hb2, int n) {
+    int i = 0;
+#if USE_FAST_MATH
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(hb + i);
+        float32x4_t e = exp4(vnegq_f32(v));
+        float32x4_t silu = vdivq_f32(v, vaddq_f32(vdupq_n_f32(1.0f), e));
+        vst1q_f32(hb + i, vmulq_f32(silu, vld1q_f32(hb2 + i)));
+    }
+    for (; i < n; i++) hb[i] = fast_silu(hb[i]) * hb2[i];
+#else
+    for (; i < n; i++) {
+        float v = hb[i];
+        v *= (1.0f / (1.0f + expf(-v)));
+        hb[i] = v * hb2[i];
+    }
+#endif
+}
+
+static void attn_scores(float *att, const float *q, const float *k,
+                        int stride, int n, int head_size) {
+    float scale = sqrtf(head_size);
+    for (int t = 0; t < n; t++) {
+        att[t] = dot(q, k + (size_t)t * stride, head_size) / scale;
+    }
+}
+
+static void attn_mix(float *out, const float *att, const float *v,
+                     int stride, int n, int head_size) {
+    int i = 0;
+    for (; i + 4 <= head_size; i += 4) {
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int t = 0; t < n; t++) {
+            acc = vfmaq_n_f32(acc, vld1q_f32(v + (size_t)t * stride + i), att[t]);
+        }
+        vst1q_f32(out + i, acc);
+    }
+    for (; i < head_size; i++) {
+        float acc = 0.0f;
+        for (int t = 0; t < n; t++) acc += att[t] * v[(size_t)t * stride + i];
+        out[i] = acc;
+    }
+}
+
+static const Kernels neon_kernels = {
+    "neon",
+    matmul_f32, matmul_f16, matmul_bf16, matmul_q4, matmul_q8, matmul_s8,
+    rmsnorm, softmax, swiglu, attn_scores, attn_mix,
+};
+
+const Kernels *kernels_neon(void) {
+    return &neon_kernels;
+}
+
+#else
+
+const Kernels *kernels_neon(void) {
+    return NULL;
+}
+
+#endif
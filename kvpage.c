@@ -0,0 +1,114 @@
+#include "kvpage.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Page p's keys start at key_pool + p * page_floats; values likewise */
+static float *key_pool;
+static float *value_pool;
+static size_t page_floats;
+static size_t layer_floats;     /* one layer's block inside a page */
+static int kv_dim;
+static int seq_len;
+
+static uint8_t refs[MAX_KV_PAGES];
+static int n_pages;
+static KVPageStats stats;
+
+int kv_pages_init(Transformer *t) {
+    Config *p = &t->config;
+    kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    seq_len = p->seq_len;
+    key_pool = t->state.key_cache;
+    value_pool = t->state.value_cache;
+    layer_floats = (size_t)KV_BLOCK_SIZE * kv_dim;
+    page_floats = layer_floats * p->n_layers;
+
+    size_t capacity = (size_t)MAX_N_LAYERS * MAX_SEQ_LEN * MAX_KV_DIM;
+    n_pages = (int)(capacity / page_floats);
+    if (n_pages > MAX_KV_PAGES) n_pages = MAX_KV_PAGES;
+
+    memset(refs, 0, sizeof(refs));
+    memset(&stats, 0, sizeof(stats));
+    stats.pages = n_pages;
+    return n_pages;
+}
+
+static int page_alloc(void) {
+    for (int i = 0; i < n_pages; i++) {
+        if (refs[i] == 0) {
+            refs[i] = 1;
+            stats.used++;
+            if (stats.used > stats.peak) stats.peak = stats.used;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void page_release(int page) {
+    if (--refs[page] == 0) stats.used--;
+}
+
+void kv_seq_init(KVSeq *seq) {
+    seq->n_blocks = 0;
+}
+
+void kv_seq_fork(KVSeq *dst, const KVSeq *src) {
+    for (int b = 0; b < src->n_blocks; b++) {
+        dst->block[b] = src->block[b];
+        refs[src->block[b]]++;
+    }
+    dst->n_blocks = src->n_blocks;
+}
+
+void kv_seq_free(KVSeq *seq) {
+    for (int b = 0; b < seq->n_blocks; b++) {
+        page_release(seq->block[b]);
+    }
+    seq->n_blocks = 0;
+}
+
+int kv_seq_prepare(KVSeq *seq, int pos) {
+    if (pos >= seq_len) return -1;
+    int b = pos / KV_BLOCK_SIZE;
+
+    /* Positions are written in order, so at most one new block */
+    if (b >= seq->n_blocks) {
+        if (b > seq->n_blocks) return -1;
+        int page = page_alloc();
+        if (page < 0) return -1;
+        seq->block[b] = (int16_t)page;
+        seq->n_blocks++;
+        return 0;
+    }
+
+    int page = seq->block[b];
+    if (refs[page] == 1) return 0;
+
+    int copy = page_alloc();
+    if (copy < 0) return -1;
+    memcpy(key_pool + copy * page_floats, key_pool + page * page_floats,
+           page_floats * sizeof(float));
+    memcpy(value_pool + copy * page_floats, value_pool + page * page_floats,
+           page_floats * sizeof(float));
+    page_release(page);
+    seq->block[b] = (int16_t)copy;
+    stats.copies++;
+    return 0;
+}
+
+float *kv_seq_key(const KVSeq *seq, int l, int pos) {
+    int page = seq->block[pos / KV_BLOCK_SIZE];
+    return key_pool + page * page_floats + l * layer_floats +
+           (pos % KV_BLOCK_SIZE) * kv_dim;
+}
+
+float *kv_seq_value(const KVSeq *seq, int l, int pos) {
+    int page = seq->block[pos / KV_BLOCK_SIZE];
+    return value_pool + page * page_floats + l * layer_floats +
+           (pos % KV_BLOCK_SIZE) * kv_dim;
+}
+
+KVPageStats kv_pages_stats(void) {
+    return stats;
+}
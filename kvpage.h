@@ -0,0 +1,73 @@
+#ifndef KVPAGE_H
+#define KVPAGE_H
+
+#include <stdint.h>
+#include "transformer.h"
+
+/*
+ * Paged KV cache for generating several hypotheses at once (beam.h).
+ * The static key/value cache memory is cut into pages, each holding
+ * KV_BLOCK_SIZE positions of every layer. A sequence maps its blocks of
+ * positions to pages through a block table. Pages are reference counted:
+ * forking a sequence shares all of its pages, and a page is copied only
+ * when a sequence writes into a block it shares (copy on write). Memory
+ * for an extra hypothesis therefore grows with how far it diverges, not
+ * with the context length.
+ *
+ * The pool reuses the contiguous cache that generate() uses, so the two
+ * don't mix: kv_pages_init() takes the memory over and invalidates the
+ * contiguous cache, and vice versa. Paged sequences don't roll past
+ * seq_len.
+ */
+#ifndef KV_BLOCK_SIZE
+#define KV_BLOCK_SIZE 16
+#endif
+#define MAX_KV_BLOCKS ((MAX_SEQ_LEN + KV_BLOCK_SIZE - 1) / KV_BLOCK_SIZE)
+
+/* Refcount table size; smaller models get more pages out of the pool */
+#ifndef MAX_KV_PAGES
+#define MAX_KV_PAGES (4 * MAX_KV_BLOCKS)
+#endif
+
+typedef struct KVSeq {
+    int n_blocks;                   /* blocks mapped */
+    int16_t block[MAX_KV_BLOCKS];   /* page of each block of positions */
+} KVSeq;
+
+/**
+ * Cut t's KV cache memory into pages sized for its config and mark them
+ * all free. Returns the number of pages.
+ */
+int kv_pages_init(Transformer *t);
+
+/** An empty sequence. */
+void kv_seq_init(KVSeq *seq);
+
+/** Make dst share every page of src. dst must be empty. */
+void kv_seq_fork(KVSeq *dst, const KVSeq *src);
+
+/** Drop seq's references; pages nobody else holds become free. */
+void kv_seq_free(KVSeq *seq);
+
+/**
+ * Make the block holding pos writable by seq: map a fresh page if it has
+ * none, copy the page if it is shared. Returns 0, or -1 when the pool is
+ * out of pages or pos is past seq_len.
+ */
+int kv_seq_prepare(KVSeq *seq, int pos);
+
+/** Key / value rows of layer l for position pos of seq. */
+float *kv_seq_key(const KVSeq *seq, int l, int pos);
+float *kv_seq_value(const KVSeq *seq, int l, int pos);
+
+/** Pool statistics: total pages, pages in use, peak use, CoW copies. */
+typedef struct {
+    int pages;
+    int used;
+    int peak;
+    int copies;
+} KVPageStats;
+
+KVPageStats kv_pages_stats(void);
+
+#endif /* KVPAGE_H */
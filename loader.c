@@ -0,0 +1,186 @@
+#include "loader.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "pico/multicore.h"
+
+#ifdef PICO_LLAMA_HOST
+#include <sched.h>
+#define loader_idle()   sched_yield()
+#define loader_signal() ((void)0)
+
+int loader_host_mbps = LOADER_HOST_MBPS;
+#else
+#include "hardware/sync.h"
+#include "pico/flash.h"
+#define loader_idle()   __wfe()
+#define loader_signal() __sev()
+#endif
+
+/* The load core1 is working on; one at a time */
+static ModelStream *current;
+
+/* ---- Copying ---- */
+
+/* Copy n bytes, keeping the host to loader_host_mbps over everything
+   copied since t0 (*copied bytes so far, advanced) */
+static void copy_paced(uint8_t *dst, const uint8_t *src, size_t n,
+                       uint64_t t0, size_t *copied) {
+#ifdef PICO_LLAMA_HOST
+    if (loader_host_mbps > 0) {
+        for (size_t done = 0; done < n;) {
+            size_t c = n - done < LOADER_CHUNK ? n - done : LOADER_CHUNK;
+            memcpy(dst + done, src + done, c);
+            done += c;
+            /* MB/s is bytes per microsecond */
+            uint64_t due = t0 + (*copied + done) / (size_t)loader_host_mbps;
+            uint64_t now = time_us_64();
+            if (now < due) {
+                struct timespec ts = { 0, (long)(due - now) * 1000 };
+                nanosleep(&ts, NULL);
+            }
+        }
+        *copied += n;
+        return;
+    }
+#else
+    (void)t0;
+#endif
+    memcpy(dst, src, n);
+    *copied += n;
+}
+
+void loader_copy(uint8_t *dst, const uint8_t *src, size_t n) {
+    size_t copied = 0;
+    copy_paced(dst, src, n, time_us_64(), &copied);
+}
+
+/* Core1: copy the spans in order, publishing each stage as it completes */
+static void loader_worker(void) {
+    ModelStream *s = current;
+    /* Span 0 starts at offset 0, so the header loader_init() copied is
+       paced again with the rest */
+    size_t copied = 0;
+#ifndef PICO_LLAMA_HOST
+    /* Core1 runs from XIP flash: let flash_safe_execute() (session saves)
+       lock it out during an erase or program, mid-copy or parked */
+    flash_safe_execute_core_init();
+#endif
+    for (int i = 0; i < s->n_spans; i++) {
+        const LoaderSpan *sp = &s->spans[i];
+        copy_paced(s->dst + sp->offset, s->src + sp->offset, sp->size,
+                   s->start_us, &copied);
+        if (i + 1 == s->n_spans || s->spans[i + 1].stage != sp->stage) {
+            s->stage_us[sp->stage] = time_us_64() - s->start_us;
+            __atomic_store_n(&s->ready, sp->stage + 1, __ATOMIC_RELEASE);
+            loader_signal();
+        }
+    }
+#ifndef PICO_LLAMA_HOST
+    /* Park until the next loader_start() resets core1 */
+    while (1) __wfe();
+#endif
+}
+
+/* ---- Planning ---- */
+
+static void add_span(ModelStream *s, const void *from, size_t size,
+                     int stage) {
+    LoaderSpan *sp = &s->spans[s->n_spans++];
+    sp->offset = (uint32_t)((const uint8_t *)from - s->dst);
+    sp->size = (uint32_t)size;
+    sp->stage = stage;
+}
+
+/* Layer l's slice of a matrix stacked across layers, n elements a layer */
+static void add_slice(ModelStream *s, const WeightTensor *w, int l, size_t n,
+                      int stage) {
+    add_span(s, (const uint8_t *)w->data + weight_bytes(w->type, l * n),
+             weight_bytes(w->type, n), stage);
+}
+
+void loader_init(ModelStream *s, const uint8_t *src, uint8_t *dst,
+                 size_t size) {
+    memset(s, 0, sizeof(*s));
+    s->src = src;
+    s->dst = dst;
+    s->size = size;
+    s->start_us = time_us_64();
+    memcpy(dst, src, size < MODEL_HEADER_SIZE ? size : MODEL_HEADER_SIZE);
+}
+
+int loader_start(ModelStream *s, const Transformer *t, const uint8_t *end) {
+    const Config *p = &t->config;
+    const TransformerWeights *w = &t->weights;
+    size_t dim = p->dim;
+    size_t kv_dim = (dim * p->n_kv_heads) / p->n_heads;
+    size_t hidden_dim = p->hidden_dim;
+    int final = LOADER_FINAL(p->n_layers);
+
+    if ((size_t)(end - s->dst) > s->size) {
+        printf("Loader: model needs %u bytes, file has %u\n",
+               (unsigned)(end - s->dst), (unsigned)s->size);
+        return -1;
+    }
+
+    /* Everything outside the layers first: header, embedding, rmsnorm
+       weights and an unshared classifier, so forward() only ever waits
+       on the layer it is about to run */
+    const uint8_t *tail = w->wcls.data == w->token_embedding_table.data ?
+                          end : (const uint8_t *)w->wcls.data;
+    const uint8_t *after_final = (const uint8_t *)(w->rms_final_weight + dim);
+    s->n_spans = 0;
+    add_span(s, s->dst, (const uint8_t *)w->wq.data - s->dst, 0);
+    add_span(s, w->rms_ffn_weight, p->n_layers * dim * sizeof(float), 0);
+    add_span(s, w->rms_final_weight, dim * sizeof(float), 0);
+    if (tail != end) add_span(s, tail, end - tail, 0);
+    for (int l = 0; l < p->n_layers; l++) {
+        int stage = LOADER_LAYER(l);
+        add_slice(s, &w->wq, l, dim * dim, stage);
+        add_slice(s, &w->wk, l, dim * kv_dim, stage);
+        add_slice(s, &w->wv, l, dim * kv_dim, stage);
+        add_slice(s, &w->wo, l, dim * dim, stage);
+        add_slice(s, &w->w1, l, dim * hidden_dim, stage);
+        add_slice(s, &w->w2, l, hidden_dim * dim, stage);
+        add_slice(s, &w->w3, l, dim * hidden_dim, stage);
+    }
+    /* Whatever lies between: legacy freq_cis tables, unused but kept so
+       the blob matches the file */
+    add_span(s, after_final, tail - after_final, final);
+    s->n_stages = final + 1;
+
+    current = s;
+    multicore_reset_core1();
+    multicore_launch_core1(loader_worker);
+    return 0;
+}
+
+/* ---- Waiting ---- */
+
+void loader_block(ModelStream *s, int stage) {
+    uint64_t t0 = time_us_64();
+    while (__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE) <= stage) {
+        loader_idle();
+    }
+    s->wait_us += time_us_64() - t0;
+}
+
+void loader_print(const ModelStream *s) {
+    int ready = __atomic_load_n(&s->ready, __ATOMIC_ACQUIRE);
+    if (ready < s->n_stages) {
+        printf("Loader: %d of %d stages resident\n", ready, s->n_stages);
+        return;
+    }
+    uint64_t us = s->stage_us[s->n_stages - 1];
+    printf("Loader: %u bytes in %llu ms (%.1f MB/s), forward waited "
+           "%llu ms\n", (unsigned)s->size, (unsigned long long)(us / 1000),
+           us ? (double)s->size / us : 0.0,
+           (unsigned long long)(s->wait_us / 1000));
+    printf("Loader: ready at ms: embedding+classifier %llu",
+           (unsigned long long)(s->stage_us[0] / 1000));
+    for (int l = 0; l < s->n_stages - 2; l++) {
+        printf(", L%d %llu", l,
+               (unsigned long long)(s->stage_us[LOADER_LAYER(l)] / 1000));
+    }
+    printf(", all %llu\n", (unsigned long long)(us / 1000));
+}
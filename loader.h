@@ -0,0 +1,92 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "transformer.h"
+
+/*
+ * Pipelined model loading. Rather than copying the whole model file into
+ * PSRAM before the first forward(), core1 copies it in the order forward()
+ * reads it, one stage at a time:
+ *
+ *   stage 0             header, embedding, rmsnorm weights, and an
+ *                       unshared classifier
+ *   stage 1 + l         layer l's slices of wq wk wv wo w1 w2 w3
+ *   stage n_layers + 1  the rest (legacy freq_cis tables); ready means
+ *                       the whole file is in
+ *
+ * Stages land in order, so the count of resident stages doubles as the
+ * per-layer ready flags. forward() checks it before each stage and only
+ * waits when it has caught up with the copy, so the prompt prefill runs
+ * while later layers are still arriving. Host builds copy on a thread
+ * throttled to loader_host_mbps to stand in for the flash read rate.
+ */
+#ifndef LOADER_HOST_MBPS
+#define LOADER_HOST_MBPS 25     /* default emulated flash -> PSRAM MB/s */
+#endif
+#define LOADER_CHUNK     4096   /* bytes copied between host rate checks */
+#define LOADER_MAX_SPANS (5 + 7 * MAX_N_LAYERS)
+#define LOADER_LAYER(l)  (1 + (l))
+#define LOADER_FINAL(n_layers) ((n_layers) + 1)
+
+#ifdef PICO_LLAMA_HOST
+extern int loader_host_mbps;    /* 0 = copy at full speed */
+#endif
+
+/* Byte range of the model file copied as part of a stage */
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+    int stage;
+} LoaderSpan;
+
+typedef struct ModelStream {
+    const uint8_t *src;     /* model file, e.g. in flash */
+    uint8_t *dst;           /* its PSRAM region */
+    size_t size;
+    LoaderSpan spans[LOADER_MAX_SPANS];
+    int n_spans;
+    int n_stages;
+    int ready;              /* stages resident; written by core1 only */
+    uint64_t start_us;
+    uint64_t stage_us[MAX_N_LAYERS + 2];  /* when each stage became ready,
+                                             from start_us */
+    uint64_t wait_us;       /* time core0 spent waiting on the copy */
+} ModelStream;
+
+/**
+ * Begin a streamed load of the size-byte model file at src into dst: copy
+ * its header so init_transformer() can parse it. Set t->loading to s
+ * before init_transformer(t, dst), which maps the weights and calls
+ * loader_start().
+ */
+void loader_init(ModelStream *s, const uint8_t *src, uint8_t *dst,
+                 size_t size);
+
+/**
+ * Plan the stages from t's weight map (tensor data ending at end) and
+ * start copying them on core1. Returns 0, or -1 if the file is too short.
+ */
+int loader_start(ModelStream *s, const Transformer *t, const uint8_t *end);
+
+/** Wait (on core0) for stage to be resident, recording the time spent. */
+void loader_block(ModelStream *s, int stage);
+
+/** Return at once if stage is resident, else loader_block(). */
+static inline void loader_wait(ModelStream *s, int stage) {
+    if (__atomic_load_n(&s->ready, __ATOMIC_ACQUIRE) <= stage) {
+        loader_block(s, stage);
+    }
+}
+
+/**
+ * Copy n bytes from the model source: memcpy on the device, held to
+ * loader_host_mbps on the host. The blocking loader for comparisons.
+ */
+void loader_copy(uint8_t *dst, const uint8_t *src, size_t n);
+
+/** Print the copy rate, when each layer became ready and time waited. */
+void loader_print(const ModelStream *s);
+
+#endif /* LOADER_H */
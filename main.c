@@ -5,39 +5,42 @@
 #include "pico/time.h"
 #include "psram.h"
 #include "model_data.h"
-#include "transformer.h"
-#include "tokenizer.h"
+#include "models.h"
 #include "sampler.h"
 #include "generate.h"
+#include "session.h"
+#include "telemetry.h"
 
-static Transformer transformer;
-static Tokenizer tokenizer;
 static Sampler sampler;
+static GenContext gen;
+static GenStats last;       /* where the last request ended */
+static int resumable = 0;
+static int model_id;
+
+#define STEPS_PER_REQUEST 256
+
+/* Stream the model in layer by layer so the first request starts before
+   the copy finishes (loader.h); 0 copies it all first, for comparison */
+#ifndef MODEL_LOAD_PIPELINED
+#define MODEL_LOAD_PIPELINED 1
+#endif
+
+/* Stream one request to serial, then save where it ended to flash */
+static void run_and_save(Model *model) {
+    generate_print(&gen, &last);
+    resumable = 1;
+    /* The model fingerprint and flash writes want the copy finished */
+    model_load_finish(model_id);
+    session_save(&model->transformer, &sampler, last.pos, last.token,
+                 SESSION_KV_TYPE);
+}
 
-static int load_model_to_psram(void) {
-    size_t psram_avail = psram_size();
-    if (psram_avail == 0) {
-        printf("Model: No PSRAM, cannot load.\n");
-        return -1;
-    }
-
-    printf("Model: Copying %u bytes from flash to PSRAM...\n",
-           (unsigned)models_stories260K_bin_len);
-
-    if (models_stories260K_bin_len > psram_avail) {
-        printf("Model: Too large for PSRAM! (%u > %u)\n",
-               (unsigned)models_stories260K_bin_len, (unsigned)psram_avail);
-        return -2;
+/* Continue the session in the KV cache for another request */
+static void resume(Model *model, int pos, int token) {
+    if (gen_resume(&gen, &model->transformer, model->tokenizer, &sampler,
+                   pos, token, STEPS_PER_REQUEST) == 0) {
+        run_and_save(model);
     }
-
-    absolute_time_t t0 = get_absolute_time();
-    memcpy((void *)PSRAM_BASE, models_stories260K_bin, models_stories260K_bin_len);
-    absolute_time_t t1 = get_absolute_time();
-    int64_t copy_us = absolute_time_diff_us(t0, t1);
-    printf("Model: Copy done in %lld ms (%.1f MB/s)\n",
-           copy_us / 1000, (double)models_stories260K_bin_len / copy_us);
-
-    return 0;
 }
 
 int main(void) {
@@ -61,36 +64,71 @@ int main(void) {
         return 1;
     }
 
-    /* Copy model weights to PSRAM */
-    if (load_model_to_psram() != 0) {
-        printf("Failed to load model to PSRAM\n");
-        return 1;
-    }
-
-    /* Init transformer (maps weights from PSRAM, sets up RunState in SRAM) */
-    if (init_transformer(&transformer) != 0) {
-        printf("Failed to init transformer\n");
-        return 1;
-    }
-
-    /* Init tokenizer from embedded flash data */
-    if (init_tokenizer(&tokenizer, transformer.config.vocab_size) != 0) {
-        printf("Failed to init tokenizer\n");
+    /* Copy the model to its own PSRAM region and initialise it (maps
+       weights, sets up RunState in SRAM, loads the tokenizer from flash).
+       Further models can be loaded alongside and picked with model_use(). */
+    uint64_t boot_us = time_us_64();
+#if MODEL_LOAD_PIPELINED
+    model_id = model_load_streamed(MODEL_DATA_NAME, model_data,
+                                   MODEL_DATA_BYTES, tokenizer_data,
+                                   TOKENIZER_DATA_BYTES);
+#else
+    model_id = model_load(MODEL_DATA_NAME, model_data, MODEL_DATA_BYTES,
+                          tokenizer_data, TOKENIZER_DATA_BYTES);
+#endif
+    if (model_id < 0) {
+        printf("Failed to load model\n");
         return 1;
     }
+    models_dump();
+    Model *model = model_use(model_id);
 
     /* Init sampler: temperature=1.0, topp=0.9, seed from timer */
     unsigned long long rng_seed = (unsigned long long)time_us_64();
-    init_sampler(&sampler, transformer.config.vocab_size, 1.0f, 0.9f, rng_seed);
-
-    printf("\n=== Generating ===\n\n");
-
-    /* Generate a story */
-    generate(&transformer, &tokenizer, &sampler, "Once upon a time", 256);
+    init_sampler(&sampler, model->transformer.config.vocab_size, 1.0f, 0.9f,
+                 rng_seed);
+
+    /* Pick up a session saved before the last reset, else start fresh */
+    int pos, token;
+    if (session_restore(&model->transformer, &sampler, &pos, &token) == 0) {
+#if SESSION_COMPARE_PREFILL
+        uint64_t prefill_us = session_reprefill_us(&model->transformer, pos);
+        printf("Session: re-prefill of %d positions would take %llu ms\n",
+               pos, (unsigned long long)(prefill_us / 1000));
+        session_restore(&model->transformer, &sampler, &pos, &token);
+#endif
+        printf("\n=== Resuming ===\n\n");
+        resume(model, pos, token);
+    } else {
+        printf("\n=== Generating ===\n\n");
+        /* Generate a story */
+        if (gen_init(&gen, &model->transformer, model->tokenizer, &sampler,
+                     "Once upon a time", STEPS_PER_REQUEST, 0) == 0) {
+            run_and_save(model);
+        }
+    }
+    if (gen.generated) {
+        printf("Boot: first token %llu ms after the model load began (%s "
+               "loader)\n",
+               (unsigned long long)((gen.first_token_us - boot_us) / 1000),
+               MODEL_LOAD_PIPELINED ? "pipelined" : "blocking");
+    }
+    model_load_finish(model_id);
 
-    /* Blink LED to show we're alive */
+    /* Blink LED to show we're alive; over serial, 't' / 'r' dump / reset
+       the latency histograms, 'c' continues the story and 'x' forgets
+       the saved session */
     printf("\n=== Done — blinking LED ===\n");
     while (1) {
+        int c = getchar_timeout_us(0);
+        if (c == 'c' && resumable) {
+            resume(model, last.pos, last.token);
+        } else if (c == 'x') {
+            session_clear();
+            printf("Session: cleared\n");
+        } else {
+            telemetry_command(c);
+        }
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
         sleep_ms(500);
         cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
@@ -0,0 +1,33 @@
+#ifndef MODEL_LIMITS_H
+#define MODEL_LIMITS_H
+
+/*
+ * Largest model the static buffers are sized for. Shared by the forward
+ * pass (transformer.h) and the weight kernels' scratch (weights.c), which
+ * must not depend on each other; cmake/EmbedModel.cmake sets them from
+ * the embedded model's Config.
+ */
+
+/* Cap sequence length to fit RunState in 520 KB SRAM */
+#ifndef MAX_SEQ_LEN
+#define MAX_SEQ_LEN 256
+#endif
+
+/* stories260K model dimensions — used for static buffer sizing.
+   Override with compile definitions to build for a larger model. */
+#ifndef MAX_DIM
+#define MAX_DIM        64
+#define MAX_HIDDEN_DIM 172
+#define MAX_N_LAYERS   5
+#define MAX_N_HEADS    8
+#define MAX_N_KV_HEADS 4
+#define MAX_VOCAB_SIZE 512
+#endif
+/* Positions forward_batch() runs together */
+#ifndef MAX_BATCH
+#define MAX_BATCH 8
+#endif
+#define MAX_KV_DIM     ((MAX_DIM * MAX_N_KV_HEADS) / MAX_N_HEADS)  /* 32 */
+#define MAX_HEAD_SIZE  (MAX_DIM / MAX_N_HEADS)                      /* 8 */
+
+#endif /* MODEL_LIMITS_H */
@@ -0,0 +1,211 @@
+#include "models.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+#include "psram_alloc.h"
+#include "placement.h"
+#include "psram.h"
+#include "loader.h"
+
+static Model models[MAX_MODELS];
+static int n_models = 0;
+static int active = -1;
+static uint64_t last_switch_us = 0;
+
+/* Only one streamed load can be in flight: core1 does the copying */
+static ModelStream stream;
+
+static Tokenizer tokenizers[MAX_TOKENIZERS];
+static const unsigned char *tokenizer_data[MAX_TOKENIZERS];
+static int n_tokenizers = 0;
+
+/* ---- Tokenizers ---- */
+
+static Tokenizer *get_tokenizer(const unsigned char *data, unsigned int size,
+                                int vocab_size) {
+    for (int i = 0; i < n_tokenizers; i++) {
+        if (tokenizer_data[i] == data &&
+            tokenizers[i].vocab_size == vocab_size) {
+            return &tokenizers[i];
+        }
+    }
+    if (n_tokenizers == MAX_TOKENIZERS) {
+        printf("Models: no tokenizer slot left (MAX_TOKENIZERS=%d)\n",
+               MAX_TOKENIZERS);
+        return NULL;
+    }
+    Tokenizer *t = &tokenizers[n_tokenizers];
+    if (init_tokenizer(t, data, size, vocab_size) != 0) return NULL;
+    tokenizer_data[n_tokenizers++] = data;
+    return t;
+}
+
+/* ---- Switching ---- */
+
+/* Take the shared SRAM state from the active model, if it isn't this one */
+static size_t activate(int id) {
+    if (id == active) return 0;
+    Transformer *next = &models[id].transformer;
+    Transformer *prev = active >= 0 ? &models[active].transformer : NULL;
+
+    if (prev) placement_unpin(prev);
+    if (!prev || prev->rope.head_size != next->rope.head_size ||
+        prev->rope.seq_len != next->rope.seq_len) {
+        rope_init(&next->rope, next->rope.head_size, next->rope.seq_len);
+    }
+    next->rope.ext_pos = -1;
+    size_t pinned = placement_repin(next);
+    active = id;
+    return pinned;
+}
+
+Model *model_use(int id) {
+    if (id < 0 || id >= n_models) return NULL;
+    if (id == active) {
+        last_switch_us = 0;
+        return &models[id];
+    }
+    const char *from = active >= 0 ? models[active].name : "none";
+    uint64_t t0 = time_us_64();
+    size_t pinned = activate(id);
+    last_switch_us = time_us_64() - t0;
+    printf("Models: %s -> %s in %llu us (%u bytes re-pinned)\n", from,
+           models[id].name, (unsigned long long)last_switch_us,
+           (unsigned)pinned);
+    return &models[id];
+}
+
+uint64_t model_switch_us(void) {
+    return last_switch_us;
+}
+
+/* ---- Loading ---- */
+
+/* Register the model in region; with loading set its copy is still
+   under way (loader.h) */
+static int adopt(const char *name, uint8_t *region,
+                 const unsigned char *tok_data, unsigned int tok_size,
+                 ModelStream *loading) {
+    if (n_models == MAX_MODELS) {
+        printf("Models: registry full (MAX_MODELS=%d)\n", MAX_MODELS);
+        psram_free(region);
+        return -1;
+    }
+    uint64_t t0 = time_us_64();
+    Model *m = &models[n_models];
+    memset(m, 0, sizeof(*m));
+    m->name = name;
+    m->transformer.loading = loading;
+
+    /* init_transformer() pins into the shared pool and rebuilds RoPE */
+    if (active >= 0) placement_unpin(&models[active].transformer);
+    active = -1;
+
+    printf("Models: initialising %s\n", name);
+    if (init_transformer(&m->transformer, region) != 0) {
+        psram_free(region);
+        return -1;
+    }
+    m->tokenizer = get_tokenizer(tok_data, tok_size,
+                                 m->transformer.config.vocab_size);
+    if (m->tokenizer == NULL) {
+        psram_free(region);
+        return -1;
+    }
+    m->tok_data = tok_data;
+
+    /* In-place conversion may have left a tail to give back */
+    psram_shrink(region, m->transformer.blob_bytes);
+    active = n_models;
+    m->load_us += time_us_64() - t0;
+    return n_models++;
+}
+
+int model_adopt(const char *name, uint8_t *region,
+                const unsigned char *tok_data, unsigned int tok_size) {
+    return adopt(name, region, tok_data, tok_size, NULL);
+}
+
+int model_load(const char *name, const unsigned char *data, size_t size,
+               const unsigned char *tok_data, unsigned int tok_size) {
+    uint8_t *region = psram_alloc(size, name);
+    if (region == NULL) return -1;
+
+    uint64_t t0 = time_us_64();
+    memcpy(region, data, size);
+    uint64_t copy_us = time_us_64() - t0;
+    printf("Models: copied %s, %u bytes in %llu ms (%.1f MB/s)\n", name,
+           (unsigned)size, (unsigned long long)(copy_us / 1000),
+           copy_us ? (double)size / copy_us : 0.0);
+
+    int id = model_adopt(name, region, tok_data, tok_size);
+    if (id >= 0) models[id].load_us += copy_us;
+    return id;
+}
+
+int model_load_streamed(const char *name, const unsigned char *data,
+                        size_t size, const unsigned char *tok_data,
+                        unsigned int tok_size) {
+    if (stream.n_stages && stream.ready < stream.n_stages) {
+        printf("Models: can't stream %s, another load is in flight\n",
+               name);
+        return -1;
+    }
+    uint8_t *region = psram_alloc(size, name);
+    if (region == NULL) return -1;
+
+    loader_init(&stream, data, region, size);
+    int id = adopt(name, region, tok_data, tok_size, &stream);
+    if (id >= 0) {
+        printf("Models: streaming %s, %u bytes, on core1\n", name,
+               (unsigned)size);
+    } else if (stream.n_stages) {
+        /* core1 may still be writing into the freed region */
+        loader_wait(&stream, stream.n_stages - 1);
+    }
+    return id;
+}
+
+void model_load_finish(int id) {
+    Model *m = model_get(id);
+    if (m == NULL || m->transformer.loading == NULL) return;
+    uint64_t t0 = time_us_64();
+    activate(id);
+    finish_transformer_load(&m->transformer);
+    m->load_us = stream.stage_us[stream.n_stages - 1];
+    loader_print(&stream);
+    printf("Models: %s resident, placement done in %llu us\n", m->name,
+           (unsigned long long)(time_us_64() - t0));
+}
+
+/* ---- Queries ---- */
+
+Model *model_get(int id) {
+    return id >= 0 && id < n_models ? &models[id] : NULL;
+}
+
+int model_find(const char *name) {
+    for (int i = 0; i < n_models; i++) {
+        if (strcmp(models[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int model_count(void) {
+    return n_models;
+}
+
+void models_dump(void) {
+    for (int i = 0; i < n_models; i++) {
+        Model *m = &models[i];
+        Config *p = &m->transformer.config;
+        printf("Models: %c %d %-16s dim=%d layers=%d vocab=%d %u bytes "
+               "at +0x%07x, %d pinned, tokenizer %d, loaded in %llu ms\n",
+               i == active ? '*' : ' ', i, m->name, p->dim, p->n_layers,
+               p->vocab_size, (unsigned)m->transformer.blob_bytes,
+               (unsigned)(m->transformer.blob - (uint8_t *)PSRAM_BASE),
+               m->transformer.pins.n, (int)(m->tokenizer - tokenizers),
+               (unsigned long long)(m->load_us / 1000));
+    }
+    psram_map_dump();
+}
@@ -0,0 +1,85 @@
+#ifndef MODELS_H
+#define MODELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "transformer.h"
+#include "tokenizer.h"
+
+/*
+ * Registry of models resident in PSRAM at the same time, each in its own
+ * psram_alloc() region with its tokenizer. Only one is active: RunState,
+ * the KV cache, the RoPE tables and the SRAM pin pool are shared, so a
+ * switch hands those over instead of copying weights. Requests must
+ * start again at pos 0 after a switch.
+ */
+#ifndef MAX_MODELS
+#define MAX_MODELS 2
+#endif
+
+typedef struct {
+    const char *name;
+    Transformer transformer;
+    Tokenizer *tokenizer;       /* shared between models with one vocabulary */
+    const unsigned char *tok_data;
+    uint64_t load_us;           /* copy + init; streamed: until the last
+                                   stage was resident */
+} Model;
+
+/**
+ * Copy a model file (e.g. a const array in flash) into a new PSRAM region,
+ * initialise it and make it active. Models loaded with the same tok_data
+ * share a tokenizer. name and tok_data must outlive the registry.
+ * Returns the model id, or -1 on failure.
+ */
+int model_load(const char *name, const unsigned char *data, size_t size,
+               const unsigned char *tok_data, unsigned int tok_size);
+
+/**
+ * Like model_load(), but returns once the header is parsed: core1 copies
+ * the rest layer by layer while forward() runs on whatever has arrived
+ * (loader.h). Call model_load_finish() before switching models or
+ * loading another; one streamed load at a time. Conversion to WTYPE_*
+ * formats makes it wait for the whole file. Returns the id or -1.
+ */
+int model_load_streamed(const char *name, const unsigned char *data,
+                        size_t size, const unsigned char *tok_data,
+                        unsigned int tok_size);
+
+/**
+ * Wait for model id's streamed load to complete, then make it active and
+ * plan its SRAM placement. Nothing to do for other models.
+ */
+void model_load_finish(int id);
+
+/**
+ * Register a model file already written into a region from psram_alloc()
+ * (host tools read files straight into PSRAM). The registry owns the
+ * region from here on, and frees it on failure. Returns the id or -1.
+ */
+int model_adopt(const char *name, uint8_t *region,
+                const unsigned char *tok_data, unsigned int tok_size);
+
+/** Look up a model by id; NULL if out of range. */
+Model *model_get(int id);
+
+/** Id of the model called name, or -1. */
+int model_find(const char *name);
+
+/** Number of registered models. */
+int model_count(void);
+
+/**
+ * Make model id active for the next request and return it (NULL for a bad
+ * id). Unpins the previous model's SRAM tensors, rebuilds the RoPE tables
+ * if the geometry differs and pins the new model's planned tensors.
+ */
+Model *model_use(int id);
+
+/** Time the last model_use() took, in microseconds. */
+uint64_t model_switch_us(void);
+
+/** Print the registry and the PSRAM memory map. */
+void models_dump(void);
+
+#endif /* MODELS_H */
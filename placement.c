@@ -0,0 +1,222 @@
+#include "placement.h"
+#include <stdio.h>
+#include <string.h>
+#include "pico/time.h"
+
+#define PROBE_TOKENS 8
+
+#if SRAM_PIN_BUDGET > 0
+static uint8_t pin_pool[SRAM_PIN_BUDGET] __attribute__((aligned(4)));
+
+typedef struct {
+    const char *name;
+    WeightTensor *tensor;   /* matrix, or NULL for rmsnorm weights */
+    float **floats;         /* rmsnorm weights */
+    size_t bytes;           /* storage size */
+    size_t reads;           /* PSRAM bytes read per token */
+    int pinned;
+    int id;                 /* index in list_candidates() order */
+} Candidate;
+
+static void *candidate_data(Candidate *c) {
+    return c->tensor ? c->tensor->data : (void *)*c->floats;
+}
+
+/* Average forward() time over a few positions; clobbers the KV cache */
+static uint64_t time_forward(Transformer *t) {
+    forward(t, 1, 0);   /* warm up */
+    uint64_t start = time_us_64();
+    for (int pos = 0; pos < PROBE_TOKENS; pos++) {
+        forward(t, 1, pos);
+    }
+    return (time_us_64() - start) / PROBE_TOKENS;
+}
+
+/* Time to stream the bytes each candidate reads per token from PSRAM */
+static uint64_t time_stream(Candidate *c, int n) {
+    volatile uint32_t sink = 0;
+    uint64_t start = time_us_64();
+    for (int i = 0; i < n; i++) {
+        const uint32_t *p = (const uint32_t *)candidate_data(&c[i]);
+        uint32_t acc = 0;
+        for (size_t j = 0; j < c[i].reads / sizeof(uint32_t); j++) {
+            acc += p[j];
+        }
+        sink += acc;
+    }
+    (void)sink;
+    return time_us_64() - start;
+}
+
+/* Higher PSRAM bytes saved per SRAM byte first; ties go to larger reads */
+static int better(const Candidate *a, const Candidate *b) {
+    uint64_t lhs = (uint64_t)a->reads * b->bytes;
+    uint64_t rhs = (uint64_t)b->reads * a->bytes;
+    if (lhs != rhs) return lhs > rhs;
+    return a->reads > b->reads;
+}
+
+/*
+ * The placement candidates of t in a fixed order (the index PinPlan
+ * records). Returns how many there are: the classifier is left out when
+ * it shares the embedding.
+ */
+static int list_candidates(Transformer *t, Candidate *c) {
+    Config *p = &t->config;
+    TransformerWeights *w = &t->weights;
+    size_t dim = p->dim;
+    size_t layers = p->n_layers;
+    size_t kv_dim = (dim * p->n_kv_heads) / p->n_heads;
+    size_t hidden_dim = p->hidden_dim;
+    size_t vocab = p->vocab_size;
+    int shared = w->wcls.data == w->token_embedding_table.data;
+
+    size_t rms_bytes = layers * dim * sizeof(float);
+    Candidate all[MAX_PINNED] = {
+        { "rms_att",   NULL, &w->rms_att_weight,   rms_bytes, 0, 0, 0 },
+        { "rms_ffn",   NULL, &w->rms_ffn_weight,   rms_bytes, 0, 0, 0 },
+        { "rms_final", NULL, &w->rms_final_weight, dim * sizeof(float), 0, 0,
+          0 },
+        { "embedding", &w->token_embedding_table, NULL,
+          weight_bytes(w->token_embedding_table.type, vocab * dim), 0, 0, 0 },
+        { "wq", &w->wq, NULL,
+          weight_bytes(w->wq.type, layers * dim * dim), 0, 0, 0 },
+        { "wk", &w->wk, NULL,
+          weight_bytes(w->wk.type, layers * dim * kv_dim), 0, 0, 0 },
+        { "wv", &w->wv, NULL,
+          weight_bytes(w->wv.type, layers * dim * kv_dim), 0, 0, 0 },
+        { "wo", &w->wo, NULL,
+          weight_bytes(w->wo.type, layers * dim * dim), 0, 0, 0 },
+        { "w1", &w->w1, NULL,
+          weight_bytes(w->w1.type, layers * dim * hidden_dim), 0, 0, 0 },
+        { "w2", &w->w2, NULL,
+          weight_bytes(w->w2.type, layers * hidden_dim * dim), 0, 0, 0 },
+        { "w3", &w->w3, NULL,
+          weight_bytes(w->w3.type, layers * dim * hidden_dim), 0, 0, 0 },
+        { "wcls", &w->wcls, NULL,
+          weight_bytes(w->wcls.type, vocab * dim), 0, 0, 0 },
+    };
+    int n = shared ? MAX_PINNED - 1 : MAX_PINNED;
+    for (int i = 0; i < n; i++) {
+        c[i] = all[i];
+        c[i].id = i;
+    }
+    return n;
+}
+
+static void set_candidate_data(Candidate *c, void *data) {
+    if (c->tensor) {
+        c->tensor->data = data;
+    } else {
+        *c->floats = (float *)data;
+    }
+}
+#endif /* SRAM_PIN_BUDGET > 0 */
+
+void plan_placement(Transformer *t) {
+    t->pins.n = 0;
+#if SRAM_PIN_BUDGET > 0
+    TransformerWeights *w = &t->weights;
+    size_t vocab = t->config.vocab_size;
+    int shared = w->wcls.data == w->token_embedding_table.data;
+    Candidate c[MAX_PINNED];
+    int n = list_candidates(t, c);
+
+    /* Every tensor is streamed once per token, except that the embedding
+       only has one row read unless it doubles as the classifier */
+    size_t total_reads = 0;
+    for (int i = 0; i < n; i++) {
+        c[i].reads = c[i].bytes;
+        if (c[i].tensor == &w->token_embedding_table && !shared) {
+            c[i].reads = c[i].bytes / vocab;
+        }
+        total_reads += c[i].reads;
+    }
+
+    /* Rank (insertion sort, n is tiny) */
+    for (int i = 1; i < n; i++) {
+        Candidate tmp = c[i];
+        int j = i - 1;
+        while (j >= 0 && better(&tmp, &c[j])) {
+            c[j + 1] = c[j];
+            j--;
+        }
+        c[j + 1] = tmp;
+    }
+
+    uint64_t stream_us = time_stream(c, n);
+    uint64_t before_us = time_forward(t);
+
+    /* Greedy fill in rank order */
+    size_t used = 0, pinned_reads = 0;
+    for (int i = 0; i < n; i++) {
+        size_t bytes = (c[i].bytes + 3) & ~(size_t)3;
+        if (used + bytes > SRAM_PIN_BUDGET) continue;
+        uint8_t *dst = pin_pool + used;
+        t->pins.tensor[t->pins.n] = (uint8_t)c[i].id;
+        t->pins.home[t->pins.n] = candidate_data(&c[i]);
+        t->pins.n++;
+        memcpy(dst, candidate_data(&c[i]), c[i].bytes);
+        set_candidate_data(&c[i], dst);
+        c[i].pinned = 1;
+        used += bytes;
+        pinned_reads += c[i].reads;
+    }
+    if (shared) w->wcls = w->token_embedding_table;
+
+    printf("Placement: SRAM budget %u bytes, %u used\n",
+           (unsigned)SRAM_PIN_BUDGET, (unsigned)used);
+    for (int i = 0; i < n; i++) {
+        printf("Placement: %-9s %-4s %8u bytes  %8u B/token  %s\n",
+               c[i].name,
+               c[i].tensor ? weight_type_name(c[i].tensor->type) : "f32",
+               (unsigned)c[i].bytes, (unsigned)c[i].reads,
+               c[i].pinned ? "SRAM" : "PSRAM");
+    }
+    if (used == 0) return;
+
+    /* Bandwidth-bound model: pinned bytes no longer cost their stream time */
+    uint64_t saved_us = stream_us * pinned_reads / total_reads;
+    uint64_t predicted_us = before_us > saved_us ? before_us - saved_us : 1;
+    uint64_t after_us = time_forward(t);
+    printf("Placement: PSRAM reads %u -> %u B/token\n",
+           (unsigned)total_reads, (unsigned)(total_reads - pinned_reads));
+    printf("Placement: %.1f tok/s -> predicted %.1f, measured %.1f tok/s\n",
+           1e6 / (double)(before_us ? before_us : 1),
+           1e6 / (double)predicted_us,
+           1e6 / (double)(after_us ? after_us : 1));
+#endif
+}
+
+void placement_unpin(Transformer *t) {
+#if SRAM_PIN_BUDGET > 0
+    Candidate c[MAX_PINNED];
+    int shared = list_candidates(t, c) < MAX_PINNED;
+    for (int i = 0; i < t->pins.n; i++) {
+        set_candidate_data(&c[t->pins.tensor[i]], t->pins.home[i]);
+    }
+    if (shared) t->weights.wcls = t->weights.token_embedding_table;
+#else
+    (void)t;
+#endif
+}
+
+size_t placement_repin(Transformer *t) {
+    size_t used = 0;
+#if SRAM_PIN_BUDGET > 0
+    Candidate c[MAX_PINNED];
+    int n = list_candidates(t, c);
+    int shared = n < MAX_PINNED;
+    for (int i = 0; i < t->pins.n; i++) {
+        Candidate *cand = &c[t->pins.tensor[i]];
+        uint8_t *dst = pin_pool + used;
+        memcpy(dst, t->pins.home[i], cand->bytes);
+        set_candidate_data(cand, dst);
+        used += (cand->bytes + 3) & ~(size_t)3;
+    }
+    if (shared) t->weights.wcls = t->weights.token_embedding_table;
+#else
+    (void)t;
+#endif
+    return used;
+}
@@ -0,0 +1,37 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "transformer.h"
+
+/*
+ * SRAM set aside for pinned weights, on top of the static RunState: what
+ * is left of the 520 KB after RunState, the KV cache, the tokenizer pool
+ * and the SDK. Firmware that embeds its model (cmake/EmbedModel.cmake)
+ * gets it computed from the model's MAX_* sizes and the SRAM budget; the
+ * 32 KB fallback is for builds that set MAX_* by hand. The link fails if
+ * it is too generous. 0 disables pinning.
+ */
+#ifndef SRAM_PIN_BUDGET
+#define SRAM_PIN_BUDGET (32 * 1024)
+#endif
+
+/**
+ * Rank the weight tensors by PSRAM bytes saved per SRAM byte, copy the
+ * winners into the SRAM pool and repoint TransformerWeights at them.
+ * Prints the placement map and the predicted and measured tok/s change.
+ */
+void plan_placement(Transformer *t);
+
+/**
+ * Point t's pinned tensors back at their PSRAM copies so another model
+ * can use the pool. The plan is kept for placement_repin().
+ */
+void placement_unpin(Transformer *t);
+
+/**
+ * Copy t's planned tensors back into the pool, without re-planning.
+ * Returns the bytes copied.
+ */
+size_t placement_repin(Transformer *t);
+
+#endif /* PLACEMENT_H */
@@ -6,12 +6,22 @@
 
 #include <stdint.h>
 #include <stddef.h>
+
+#ifdef PICO_LLAMA_HOST
+/* Host builds: a heap buffer stands in for the XIP window (host/psram_host.c) */
+extern uint8_t *psram_host_base;
+#define PSRAM_BASE         ((uintptr_t)psram_host_base)
+#ifndef PSRAM_WINDOW_SIZE
+#define PSRAM_WINDOW_SIZE  (64 << 20)   /* room for stories15M in fp32 */
+#endif
+#else
 #include "hardware/platform_defs.h"
 #include "hardware/regs/addressmap.h"
 
 #define PSRAM_BASE         _u(0x11000000)
 #define PSRAM_NOCACHE_BASE _u(0x15000000)
 #define PSRAM_WINDOW_SIZE  (16 << 20)
+#endif
 
 #define PSRAM_CS_PIN 47
 
@@ -0,0 +1,116 @@
+#include "psram_alloc.h"
+#include <stdio.h>
+#include <string.h>
+#include "psram.h"
+
+typedef struct {
+    const char *name;
+    uint8_t *base;
+    size_t size;
+} PsramRegion;
+
+/* Sorted by base address */
+static PsramRegion regions[MAX_PSRAM_REGIONS];
+static int n_regions = 0;
+
+static uint8_t *window_start(void) {
+    return (uint8_t *)PSRAM_BASE;
+}
+
+static uint8_t *window_end(void) {
+    return (uint8_t *)PSRAM_BASE + psram_size();
+}
+
+static uint8_t *align_up(uint8_t *p) {
+    uintptr_t a = PSRAM_REGION_ALIGN;
+    return (uint8_t *)(((uintptr_t)p + a - 1) & ~(a - 1));
+}
+
+/* Start of the gap before regions[i] (i == n_regions: the last gap) */
+static uint8_t *gap_start(int i) {
+    if (i == 0) return window_start();
+    return regions[i - 1].base + regions[i - 1].size;
+}
+
+static uint8_t *gap_end(int i) {
+    return i < n_regions ? regions[i].base : window_end();
+}
+
+static int find(uint8_t *region) {
+    for (int i = 0; i < n_regions; i++) {
+        if (regions[i].base == region) return i;
+    }
+    return -1;
+}
+
+uint8_t *psram_alloc(size_t size, const char *name) {
+    if (size == 0 || n_regions == MAX_PSRAM_REGIONS) {
+        printf("PSRAM: cannot allocate %u bytes for %s (%d regions)\n",
+               (unsigned)size, name, n_regions);
+        return NULL;
+    }
+    for (int i = 0; i <= n_regions; i++) {
+        uint8_t *start = align_up(gap_start(i));
+        uint8_t *end = gap_end(i);
+        if (start > end || (size_t)(end - start) < size) continue;
+
+        memmove(&regions[i + 1], &regions[i],
+                (n_regions - i) * sizeof(PsramRegion));
+        regions[i].name = name;
+        regions[i].base = start;
+        regions[i].size = size;
+        n_regions++;
+        return start;
+    }
+    printf("PSRAM: no gap of %u bytes for %s (largest free %u)\n",
+           (unsigned)size, name, (unsigned)psram_largest_free());
+    return NULL;
+}
+
+void psram_shrink(uint8_t *region, size_t size) {
+    int i = find(region);
+    if (i >= 0 && size > 0 && size < regions[i].size) {
+        regions[i].size = size;
+    }
+}
+
+void psram_free(uint8_t *region) {
+    int i = find(region);
+    if (i < 0) return;
+    memmove(&regions[i], &regions[i + 1],
+            (n_regions - i - 1) * sizeof(PsramRegion));
+    n_regions--;
+}
+
+size_t psram_largest_free(void) {
+    size_t best = 0;
+    for (int i = 0; i <= n_regions; i++) {
+        uint8_t *start = align_up(gap_start(i));
+        uint8_t *end = gap_end(i);
+        if (start < end && (size_t)(end - start) > best) {
+            best = end - start;
+        }
+    }
+    return best;
+}
+
+void psram_map_dump(void) {
+    size_t used = 0;
+    printf("PSRAM: map of %u KB window\n", (unsigned)(psram_size() >> 10));
+    for (int i = 0; i <= n_regions; i++) {
+        uint8_t *start = gap_start(i);
+        uint8_t *end = gap_end(i);
+        if (end > start) {
+            printf("PSRAM:   +0x%07x %9u bytes  (free)\n",
+                   (unsigned)(start - window_start()),
+                   (unsigned)(end - start));
+        }
+        if (i == n_regions) break;
+        printf("PSRAM:   +0x%07x %9u bytes  %s\n",
+               (unsigned)(regions[i].base - window_start()),
+               (unsigned)regions[i].size, regions[i].name);
+        used += regions[i].size;
+    }
+    printf("PSRAM: %u bytes in %d regions, largest free %u\n",
+           (unsigned)used, n_regions, (unsigned)psram_largest_free());
+}
@@ -0,0 +1,36 @@
+#ifndef PSRAM_ALLOC_H
+#define PSRAM_ALLOC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Region allocator over the PSRAM window, so several models (and anything
+ * else that wants PSRAM) can stay resident side by side. First fit over a
+ * small static table kept in address order; no headers inside PSRAM.
+ */
+#ifndef MAX_PSRAM_REGIONS
+#define MAX_PSRAM_REGIONS 8
+#endif
+#define PSRAM_REGION_ALIGN 64
+
+/**
+ * Reserve size bytes of PSRAM, aligned to PSRAM_REGION_ALIGN. name labels
+ * the region in psram_map_dump() and must outlive it. Returns NULL if no
+ * gap is large enough or the table is full.
+ */
+uint8_t *psram_alloc(size_t size, const char *name);
+
+/** Give back the tail of a region, e.g. after in-place weight conversion. */
+void psram_shrink(uint8_t *region, size_t size);
+
+/** Release a region. */
+void psram_free(uint8_t *region);
+
+/** Largest contiguous free block in bytes. */
+size_t psram_largest_free(void);
+
+/** Print every region and gap with offsets and sizes. */
+void psram_map_dump(void);
+
+#endif /* PSRAM_ALLOC_H */
@@ -0,0 +1,95 @@
+#include "rope.h"
+#include "transformer.h"
+#include <math.h>
+#include <stdio.h>
+
+#define ROPE_PAIRS (MAX_HEAD_SIZE / 2)
+
+static float rope_inv_freq[ROPE_PAIRS];
+static float rope_cos[MAX_SEQ_LEN * ROPE_PAIRS];
+static float rope_sin[MAX_SEQ_LEN * ROPE_PAIRS];
+static float rope_ext_cos[ROPE_PAIRS];
+static float rope_ext_sin[ROPE_PAIRS];
+
+int rope_init(RopeTable *r, int head_size, int seq_len) {
+    if (head_size > MAX_HEAD_SIZE || seq_len > MAX_SEQ_LEN) {
+        printf("RoPE: ERROR — %d x %d exceeds table size\n",
+               seq_len, head_size);
+        return -1;
+    }
+
+    int pairs = head_size / 2;
+    r->head_size = head_size;
+    r->seq_len = seq_len;
+    r->inv_freq = rope_inv_freq;
+    r->cos_table = rope_cos;
+    r->sin_table = rope_sin;
+    r->ext_cos = rope_ext_cos;
+    r->ext_sin = rope_ext_sin;
+    r->ext_pos = -1;
+
+    for (int j = 0; j < pairs; j++) {
+        r->inv_freq[j] = 1.0f / powf(10000.0f, (2 * j) / (float)head_size);
+    }
+    for (int pos = 0; pos < seq_len; pos++) {
+        for (int j = 0; j < pairs; j++) {
+            float val = pos * r->inv_freq[j];
+            r->cos_table[pos * pairs + j] = cosf(val);
+            r->sin_table[pos * pairs + j] = sinf(val);
+        }
+    }
+    return 0;
+}
+
+void rope_row(RopeTable *r, int pos, const float **cos_row,
+              const float **sin_row) {
+    int pairs = r->head_size / 2;
+
+    if (pos < r->seq_len) {
+        *cos_row = r->cos_table + pos * pairs;
+        *sin_row = r->sin_table + pos * pairs;
+        return;
+    }
+
+    int prev = pos - 1;
+    if (prev < r->seq_len || prev == r->ext_pos) {
+        /* Angle addition with the position-1 row, renormalised so rounding
+           only drifts the phase, not the magnitude */
+        const float *c_prev = prev < r->seq_len ?
+            r->cos_table + prev * pairs : r->ext_cos;
+        const float *s_prev = prev < r->seq_len ?
+            r->sin_table + prev * pairs : r->ext_sin;
+        const float *c1 = r->cos_table + pairs;
+        const float *s1 = r->sin_table + pairs;
+        for (int j = 0; j < pairs; j++) {
+            float c = c_prev[j] * c1[j] - s_prev[j] * s1[j];
+            float s = s_prev[j] * c1[j] + c_prev[j] * s1[j];
+            float norm = 1.0f / sqrtf(c * c + s * s);
+            r->ext_cos[j] = c * norm;
+            r->ext_sin[j] = s * norm;
+        }
+    } else {
+        for (int j = 0; j < pairs; j++) {
+            float val = pos * r->inv_freq[j];
+            r->ext_cos[j] = cosf(val);
+            r->ext_sin[j] = sinf(val);
+        }
+    }
+    r->ext_pos = pos;
+    *cos_row = r->ext_cos;
+    *sin_row = r->ext_sin;
+}
+
+void rope_rotate(float *vec, int n, int head_size, const float *cos_row,
+                 const float *sin_row) {
+    int pairs = head_size / 2;
+    for (int h = 0; h < n; h += head_size) {
+        float *v = vec + h;
+        for (int j = 0; j < pairs; j++) {
+            float v0 = v[2 * j];
+            float v1 = v[2 * j + 1];
+            v[2 * j]     = v0 * cos_row[j] - v1 * sin_row[j];
+            v[2 * j + 1] = v0 * sin_row[j] + v1 * cos_row[j];
+        }
+    }
+}
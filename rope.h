@@ -0,0 +1,35 @@
+#ifndef ROPE_H
+#define ROPE_H
+
+/*
+ * Rotary position encoding tables. The per-pair inverse frequencies and
+ * the cos/sin of every position below seq_len are computed once at init
+ * and shared by all layers and heads.
+ */
+typedef struct {
+    int head_size;
+    int seq_len;
+    float *inv_freq;    /* [head_size / 2] */
+    float *cos_table;   /* [seq_len][head_size / 2] */
+    float *sin_table;
+    float *ext_cos;     /* row for a position past seq_len */
+    float *ext_sin;
+    int ext_pos;        /* position held in ext_cos/ext_sin, or -1 */
+} RopeTable;
+
+/** Build the tables into static buffers. Returns 0 on success. */
+int rope_init(RopeTable *r, int head_size, int seq_len);
+
+/**
+ * Look up the cos/sin row for pos. Positions past the table (rolling KV
+ * cache) are advanced by one rotation from the previous row when
+ * generating sequentially, and computed directly otherwise.
+ */
+void rope_row(RopeTable *r, int pos, const float **cos_row,
+              const float **sin_row);
+
+/** Rotate n values of vec (whole heads) by a row from rope_row(). */
+void rope_rotate(float *vec, int n, int head_size, const float *cos_row,
+                 const float *sin_row);
+
+#endif /* ROPE_H */
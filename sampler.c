@@ -1,12 +1,15 @@
 #include "sampler.h"
 #include <stdlib.h>
+#include "transformer.h"
 
 /* Declared in transformer.c */
 extern void softmax(float *x, int size);
 
-/* Static ProbIndex buffer — sized for MAX_VOCAB (512) */
-#define MAX_VOCAB 512
-static ProbIndex probindex_buf[MAX_VOCAB];
+/* Static ProbIndex buffer — sized for MAX_VOCAB_SIZE */
+static ProbIndex probindex_buf[MAX_VOCAB_SIZE];
+
+/* Token id of each logit kept by a mask */
+static int masked_ids[MAX_VOCAB_SIZE];
 
 void init_sampler(Sampler *sampler, int vocab_size, float temperature,
                   float topp, unsigned long long rng_seed) {
@@ -15,6 +18,7 @@ void init_sampler(Sampler *sampler, int vocab_size, float temperature,
     sampler->topp = topp;
     sampler->rng_state = rng_seed;
     sampler->probindex = probindex_buf;
+    sampler->mask = NULL;
 }
 
 static unsigned int random_u32(unsigned long long *state) {
@@ -89,22 +93,48 @@ static int sample_topp(float *probabilities, int n, float topp,
     return probindex[last_idx].index;
 }
 
+/*
+ * Move the logits of tokens set in mask to the front, in id order, and
+ * record their ids. One pass over the bitset; cleared words cost nothing.
+ */
+static int apply_mask(float *logits, const uint32_t *mask, int n) {
+    int kept = 0;
+    for (int w = 0; w < (n + 31) / 32; w++) {
+        uint32_t bits = mask[w];
+        while (bits) {
+            int id = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (id >= n) break;
+            logits[kept] = logits[id];
+            masked_ids[kept++] = id;
+        }
+    }
+    return kept;
+}
+
 int sample(Sampler *sampler, float *logits) {
+    int n = sampler->vocab_size;
+    if (sampler->mask) {
+        n = apply_mask(logits, sampler->mask, n);
+        if (n == 0) return 1;
+        if (n == 1) return masked_ids[0];
+    }
+
     int next;
     if (sampler->temperature == 0.0f) {
-        next = sample_argmax(logits, sampler->vocab_size);
+        next = sample_argmax(logits, n);
     } else {
-        for (int q = 0; q < sampler->vocab_size; q++) {
+        for (int q = 0; q < n; q++) {
             logits[q] /= sampler->temperature;
         }
-        softmax(logits, sampler->vocab_size);
+        softmax(logits, n);
         float coin = random_f32(&sampler->rng_state);
         if (sampler->topp <= 0 || sampler->topp >= 1) {
-            next = sample_mult(logits, sampler->vocab_size, coin);
+            next = sample_mult(logits, n, coin);
         } else {
-            next = sample_topp(logits, sampler->vocab_size, sampler->topp,
-                              sampler->probindex, coin);
+            next = sample_topp(logits, n, sampler->topp, sampler->probindex,
+                               coin);
         }
     }
-    return next;
+    return sampler->mask ? masked_ids[next] : next;
 }
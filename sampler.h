@@ -1,6 +1,8 @@
 #ifndef SAMPLER_H
 #define SAMPLER_H
 
+#include <stdint.h>
+
 typedef struct {
     float prob;
     int index;
@@ -12,13 +14,19 @@ typedef struct {
     float temperature;
     float topp;
     unsigned long long rng_state;
+    /* Allowed tokens, bit t of word t / 32 (constraint.h); NULL = all.
+       Other tokens are dropped before temperature and softmax. */
+    const uint32_t *mask;
 } Sampler;
 
 /** Initialise sampler with static ProbIndex buffer. */
 void init_sampler(Sampler *sampler, int vocab_size, float temperature,
                   float topp, unsigned long long rng_seed);
 
-/** Sample next token from logits. */
+/**
+ * Sample next token from logits (overwritten). With a mask set, returns
+ * BOS if it allows nothing.
+ */
 int sample(Sampler *sampler, float *logits);
 
 #endif /* SAMPLER_H */
@@ -0,0 +1,129 @@
+#include "score.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pico/time.h"
+
+/* Classifier rows scored per weight_matmul_batch() call */
+#define SCORE_VOCAB_CHUNK 32
+
+static float chunk_logits[MAX_BATCH * SCORE_VOCAB_CHUNK];
+static float cls_row[MAX_DIM];
+static int text_tokens[SCORE_MAX_TOKENS];
+
+/*
+ * log p(target[b]) for the n hidden states from forward_batch(). Streams
+ * the classifier once for the batch, keeping a running max and sum of
+ * exponentials per position. Positions with target -1 are skipped.
+ */
+static void batch_logprobs(Transformer *t, const float *hidden, int n,
+                           const int *target, double *logprob) {
+    Config *p = &t->config;
+    float max[MAX_BATCH], hit[MAX_BATCH];
+    double sum[MAX_BATCH];
+    for (int b = 0; b < n; b++) {
+        max[b] = -INFINITY;
+        sum[b] = 0.0;
+        hit[b] = 0.0f;
+    }
+
+    for (int r0 = 0; r0 < p->vocab_size; r0 += SCORE_VOCAB_CHUNK) {
+        int rows = p->vocab_size - r0 < SCORE_VOCAB_CHUNK ?
+                   p->vocab_size - r0 : SCORE_VOCAB_CHUNK;
+        weight_matmul_batch(chunk_logits, hidden, &t->weights.wcls,
+                            (size_t)r0 * p->dim, p->dim, rows, n, cls_row);
+        for (int b = 0; b < n; b++) {
+            if (target[b] < 0) continue;
+            const float *lg = chunk_logits + b * rows;
+            for (int r = 0; r < rows; r++) {
+                if (lg[r] > max[b]) {
+                    sum[b] = sum[b] * exp(max[b] - lg[r]) + 1.0;
+                    max[b] = lg[r];
+                } else {
+                    sum[b] += exp(lg[r] - max[b]);
+                }
+            }
+            if (target[b] >= r0 && target[b] < r0 + rows) {
+                hit[b] = lg[target[b] - r0];
+            }
+        }
+    }
+
+    for (int b = 0; b < n; b++) {
+        if (target[b] >= 0) {
+            logprob[b] = (double)hit[b] - max[b] - log(sum[b]);
+        }
+    }
+}
+
+int score_tokens(Transformer *t, const int *tokens, int n, int stride,
+                 ScoreStats *stats) {
+    int window = t->config.seq_len;
+    if (stride <= 0) stride = window / 2;
+    if (stride > window) stride = window;
+    if (t->kv_seq) {
+        printf("Score: needs the contiguous KV cache\n");
+        return -1;
+    }
+
+    uint64_t t0 = time_us_64();
+    int scored = 1;     /* tokens[0..scored) are done or have no prediction */
+    for (int start = 0; scored < n; start += stride) {
+        int end = start + window < n ? start + window : n;
+        stats->windows++;
+
+        /* Run the window from position 0; tokens[i] predicts tokens[i+1]
+           and counts if tokens[i+1] hasn't been scored yet */
+        for (int i = start; i < end; i += MAX_BATCH) {
+            int nb = end - i < MAX_BATCH ? end - i : MAX_BATCH;
+            float *hidden = forward_batch(t, tokens + i, nb, i - start);
+            if (!hidden) return -1;
+            stats->positions += nb;
+
+            int target[MAX_BATCH], any = 0;
+            for (int b = 0; b < nb; b++) {
+                int next = i + b + 1;
+                target[b] = next >= scored && next < end ? tokens[next] : -1;
+                any |= target[b] >= 0;
+            }
+            if (!any) continue;
+            double logprob[MAX_BATCH];
+            batch_logprobs(t, hidden, nb, target, logprob);
+            for (int b = 0; b < nb; b++) {
+                if (target[b] < 0) continue;
+                stats->nll -= logprob[b];
+                stats->tokens++;
+            }
+        }
+        scored = end;
+    }
+    stats->elapsed_us += time_us_64() - t0;
+    return 0;
+}
+
+int score_text(Transformer *t, Tokenizer *tokenizer, const char *text,
+               int stride, ScoreStats *stats) {
+    /* encode() needs room for text length + 3 tokens */
+    if (strlen(text) + 3 > SCORE_MAX_TOKENS) {
+        printf("Score: text longer than %d bytes\n", SCORE_MAX_TOKENS - 3);
+        return -1;
+    }
+    int n;
+    encode(tokenizer, (char *)text, 1, 0, text_tokens, &n);
+    return score_tokens(t, text_tokens, n, stride, stats);
+}
+
+double score_perplexity(const ScoreStats *stats) {
+    return stats->tokens ? exp(stats->nll / stats->tokens) : 0.0;
+}
+
+void score_print(const ScoreStats *stats) {
+    double secs = stats->elapsed_us / 1e6;
+    printf("Score: %d tokens, nll %.4f/token, perplexity %.3f\n",
+           stats->tokens, stats->tokens ? stats->nll / stats->tokens : 0.0,
+           score_perplexity(stats));
+    printf("Score: %d positions in %d windows, %.1f ms, %.1f tok/s scored "
+           "(batch %d)\n",
+           stats->positions, stats->windows, stats->elapsed_us / 1000.0,
+           secs > 0 ? stats->tokens / secs : 0.0, MAX_BATCH);
+}
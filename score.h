@@ -0,0 +1,57 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include <stdint.h>
+#include "transformer.h"
+#include "tokenizer.h"
+
+/*
+ * Teacher-forced scoring: feed a known token stream and add up the
+ * log-probability the model gives each actual next token, for perplexity
+ * on held-out text. No sampling; positions run MAX_BATCH at a time through
+ * forward_batch(), and the classifier is applied a few vocab rows at a time
+ * with a running log-sum-exp, so no full logits vector is kept per
+ * position.
+ *
+ * Text longer than seq_len is scored in sliding windows of seq_len
+ * positions, each starting stride tokens after the last with a fresh KV
+ * cache. A window only scores the tokens no earlier window did, so every
+ * token is scored once, with at least seq_len - stride tokens of context
+ * (bar the first window). Smaller strides give more context per token and
+ * cost more positions.
+ */
+#ifndef SCORE_MAX_TOKENS
+#define SCORE_MAX_TOKENS 4096   /* text score_text() can take, in tokens */
+#endif
+
+typedef struct {
+    int tokens;             /* next-token predictions scored */
+    int positions;          /* positions run, window overlap included */
+    int windows;
+    double nll;             /* sum of -log p(actual next token) */
+    uint64_t elapsed_us;
+} ScoreStats;
+
+/**
+ * Score tokens[1..n) given the tokens before each, adding to *stats (zero
+ * it first; successive calls accumulate, e.g. one per document). stride 0
+ * means seq_len / 2. Uses the contiguous KV cache; t->kv_seq must be NULL.
+ * Returns 0 on success.
+ */
+int score_tokens(Transformer *t, const int *tokens, int n, int stride,
+                 ScoreStats *stats);
+
+/**
+ * Encode text with a leading BOS and score it with score_tokens().
+ * Returns 0 on success, -1 if it doesn't fit SCORE_MAX_TOKENS.
+ */
+int score_text(Transformer *t, Tokenizer *tokenizer, const char *text,
+               int stride, ScoreStats *stats);
+
+/** exp(nll / tokens); 0 if nothing was scored. */
+double score_perplexity(const ScoreStats *stats);
+
+/** Print perplexity and scoring throughput over USB serial. */
+void score_print(const ScoreStats *stats);
+
+#endif /* SCORE_H */
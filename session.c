@@ -0,0 +1,270 @@
+#include "session.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pico/time.h"
+#include "flash_store.h"
+#include "loader.h"
+
+#define MODEL_CRC_BYTES 4096
+
+/* ---- CRC-32 (IEEE, a nibble at a time from a 64-byte table) ---- */
+
+static const uint32_t crc_nibble[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t n) {
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ crc_nibble[crc & 15];
+        crc = (crc >> 4) ^ crc_nibble[crc & 15];
+    }
+    return ~crc;
+}
+
+static uint32_t model_crc(const Transformer *t) {
+    size_t n = t->blob_bytes < MODEL_CRC_BYTES ? t->blob_bytes :
+               MODEL_CRC_BYTES;
+    /* A streamed load has those bytes once stage 0 (up to wq) is in */
+    if (t->loading) {
+        size_t head = (const uint8_t *)t->weights.wq.data - t->blob;
+        loader_wait(t->loading,
+                    n <= head ? 0 : LOADER_FINAL(t->config.n_layers));
+    }
+    return crc32_update(0, t->blob, n);
+}
+
+/* ---- Page writer ---- */
+
+/* Payload goes after the header page, one flash page at a time */
+typedef struct {
+    uint8_t page[FLASH_STORE_PAGE];
+    uint32_t fill;
+    uint32_t offset;
+    uint32_t written;
+    uint32_t crc;
+    int error;
+} PageWriter;
+
+static PageWriter writer;
+
+static void writer_flush(PageWriter *w) {
+    if (w->fill == 0 || w->error) return;
+    memset(w->page + w->fill, 0xff, FLASH_STORE_PAGE - w->fill);
+    if (flash_store_program(w->offset, w->page, FLASH_STORE_PAGE) != 0) {
+        w->error = 1;
+    }
+    w->offset += FLASH_STORE_PAGE;
+    w->fill = 0;
+}
+
+static void writer_put(PageWriter *w, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    w->crc = crc32_update(w->crc, p, n);
+    w->written += n;
+    while (n > 0) {
+        size_t chunk = FLASH_STORE_PAGE - w->fill;
+        if (chunk > n) chunk = n;
+        memcpy(w->page + w->fill, p, chunk);
+        w->fill += chunk;
+        p += chunk;
+        n -= chunk;
+        if (w->fill == FLASH_STORE_PAGE) writer_flush(w);
+    }
+}
+
+/* Keep every KV block 4-byte aligned in flash */
+static void writer_align(PageWriter *w) {
+    static const uint8_t zeros[3] = { 0 };
+    if (w->written & 3) writer_put(w, zeros, 4 - (w->written & 3));
+}
+
+/* ---- Save / restore ---- */
+
+static int kv_slots(const Config *p, int pos) {
+    return pos < p->seq_len ? pos : p->seq_len;
+}
+
+static size_t kv_block_bytes(WeightType type, size_t n) {
+    return (weight_bytes(type, n) + 3) & ~(size_t)3;
+}
+
+static size_t payload_size(const Config *p, int n_slots, WeightType type) {
+    size_t kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    size_t bytes = ((size_t)n_slots * sizeof(int32_t) + 3) & ~(size_t)3;
+    bytes += 2 * p->n_layers * kv_block_bytes(type, n_slots * kv_dim);
+    return bytes;
+}
+
+long session_save(const Transformer *t, const Sampler *sampler, int pos,
+                  int token, WeightType kv_type) {
+    const Config *p = &t->config;
+    const RunState *s = &t->state;
+    int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    int n_slots = kv_slots(p, pos);
+    /* s8 would prune half of every cache row, not just round it */
+    if (!weight_row_ok(kv_type, kv_dim) || kv_type == WEIGHT_S8) {
+        kv_type = WEIGHT_F16;
+    }
+
+    uint64_t t0 = time_us_64();
+    size_t payload = payload_size(p, n_slots, kv_type);
+    size_t total = FLASH_STORE_PAGE + payload;
+    if (total > SESSION_FLASH_SIZE) {
+        printf("Session: %u bytes don't fit the %u-byte flash region\n",
+               (unsigned)total, (unsigned)SESSION_FLASH_SIZE);
+        return -1;
+    }
+    uint32_t erase = (total + FLASH_STORE_SECTOR - 1) &
+                     ~(uint32_t)(FLASH_STORE_SECTOR - 1);
+    if (flash_store_erase(0, erase) != 0) return -2;
+
+    PageWriter *w = &writer;
+    memset(w, 0, sizeof(*w));
+    w->offset = FLASH_STORE_PAGE;
+
+    for (int i = 0; i < n_slots; i++) {
+        int32_t tok = s->kv_tokens[i];
+        writer_put(w, &tok, sizeof(tok));
+    }
+    writer_align(w);
+
+    /* Keys then values, one layer's filled slots at a time, row by row */
+    WeightError err = { 0 };
+    float row[MAX_KV_DIM];
+    uint8_t packed[MAX_KV_DIM * sizeof(float)];
+    for (int c = 0; c < 2; c++) {
+        const float *cache = c == 0 ? s->key_cache : s->value_cache;
+        for (int l = 0; l < p->n_layers; l++) {
+            const float *layer = cache + (size_t)l * p->seq_len * kv_dim;
+            for (int i = 0; i < n_slots; i++) {
+                memcpy(row, layer + (size_t)i * kv_dim, kv_dim * sizeof(float));
+                size_t n = weight_convert(packed, row, kv_dim, kv_type, &err);
+                writer_put(w, packed, n);
+            }
+            writer_align(w);
+        }
+    }
+    writer_flush(w);
+    if (w->error) return -3;
+
+    /* Header last: until it lands, the region holds no session */
+    SessionHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SESSION_MAGIC;
+    hdr.version = SESSION_VERSION;
+    hdr.config = *p;
+    hdr.model_crc = model_crc(t);
+    hdr.pos = pos;
+    hdr.token = token;
+    hdr.n_slots = n_slots;
+    hdr.kv_type = kv_type;
+    hdr.rng_state = sampler->rng_state;
+    hdr.temperature = sampler->temperature;
+    hdr.topp = sampler->topp;
+    hdr.payload_bytes = w->written;
+    hdr.payload_crc = w->crc;
+    memset(w->page, 0xff, FLASH_STORE_PAGE);
+    memcpy(w->page, &hdr, sizeof(hdr));
+    if (flash_store_program(0, w->page, FLASH_STORE_PAGE) != 0) return -4;
+
+    uint64_t save_us = time_us_64() - t0;
+    double rel = err.sum_sq_ref > 0.0 ?
+                 sqrt(err.sum_sq_err / err.sum_sq_ref) : 0.0;
+    printf("Session: saved pos %d, %d KV slots as %s, %u bytes in %llu ms "
+           "(rel_rms=%.2e)\n", pos, n_slots, weight_type_name(kv_type),
+           (unsigned)(FLASH_STORE_PAGE + w->written),
+           (unsigned long long)(save_us / 1000), rel);
+    return (long)(FLASH_STORE_PAGE + w->written);
+}
+
+/* Header of a session that fits this model, or NULL */
+static const SessionHeader *valid_header(const Transformer *t) {
+    const uint8_t *base = flash_store_read(0);
+    if (base == NULL) return NULL;
+    static SessionHeader hdr;
+    memcpy(&hdr, base, sizeof(hdr));
+    if (hdr.magic != SESSION_MAGIC) return NULL;
+    if (hdr.version != SESSION_VERSION) {
+        printf("Session: unsupported version %d\n", (int)hdr.version);
+        return NULL;
+    }
+    if (memcmp(&hdr.config, &t->config, sizeof(Config)) != 0 ||
+        hdr.model_crc != model_crc(t)) {
+        printf("Session: saved for a different model, ignoring\n");
+        return NULL;
+    }
+    if (hdr.kv_type < 0 || hdr.kv_type >= N_WEIGHT_TYPES ||
+        hdr.n_slots < 0 || hdr.n_slots > t->config.seq_len ||
+        hdr.n_slots != kv_slots(&t->config, hdr.pos) ||
+        hdr.payload_bytes != payload_size(&t->config, hdr.n_slots,
+                                          (WeightType)hdr.kv_type) ||
+        FLASH_STORE_PAGE + hdr.payload_bytes > SESSION_FLASH_SIZE) {
+        printf("Session: corrupt header, ignoring\n");
+        return NULL;
+    }
+    const uint8_t *payload = flash_store_read(FLASH_STORE_PAGE);
+    if (crc32_update(0, payload, hdr.payload_bytes) != hdr.payload_crc) {
+        printf("Session: payload CRC mismatch, ignoring\n");
+        return NULL;
+    }
+    return &hdr;
+}
+
+int session_restore(Transformer *t, Sampler *sampler, int *pos, int *token) {
+    uint64_t t0 = time_us_64();
+    const SessionHeader *hdr = valid_header(t);
+    if (hdr == NULL) return -1;
+
+    Config *p = &t->config;
+    RunState *s = &t->state;
+    int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    int n_slots = hdr->n_slots;
+    WeightType type = (WeightType)hdr->kv_type;
+
+    const uint8_t *src = flash_store_read(FLASH_STORE_PAGE);
+    memcpy(s->kv_tokens, src, n_slots * sizeof(int32_t));
+    src += ((size_t)n_slots * sizeof(int32_t) + 3) & ~(size_t)3;
+
+    size_t n = (size_t)n_slots * kv_dim;
+    for (int c = 0; c < 2; c++) {
+        float *cache = c == 0 ? s->key_cache : s->value_cache;
+        for (int l = 0; l < p->n_layers; l++) {
+            WeightTensor block = { .data = (void *)src, .type = type };
+            weight_row(cache + (size_t)l * p->seq_len * kv_dim, &block, 0,
+                       (int)n);
+            src += kv_block_bytes(type, n);
+        }
+    }
+
+    sampler->rng_state = hdr->rng_state;
+    sampler->temperature = hdr->temperature;
+    sampler->topp = hdr->topp;
+    t->rope.ext_pos = -1;
+    *pos = hdr->pos;
+    *token = hdr->token;
+
+    printf("Session: restored pos %d, %d KV slots (%s) in %llu us\n",
+           hdr->pos, n_slots, weight_type_name(type),
+           (unsigned long long)(time_us_64() - t0));
+    return 0;
+}
+
+void session_clear(void) {
+    flash_store_erase(0, FLASH_STORE_SECTOR);
+}
+
+uint64_t session_reprefill_us(Transformer *t, int pos) {
+    if (pos > t->config.seq_len) return 0;
+    RunState *s = &t->state;
+    uint64_t t0 = time_us_64();
+    for (int i = 0; i < pos; i++) {
+        forward(t, s->kv_tokens[i], i);
+    }
+    return time_us_64() - t0;
+}
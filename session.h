@@ -0,0 +1,69 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include "transformer.h"
+#include "sampler.h"
+
+/*
+ * Save a generation session to the flash store (flash_store.h) and bring
+ * it back after a reboot: the position, the token to feed next, the
+ * token held in each KV slot, the sampler state and the KV cache itself.
+ * The cache can be stored in any WeightType to trade restore accuracy for
+ * flash space and write time; fp16 halves it and is close to exact.
+ *
+ * The header is programmed last, so a reset mid-save leaves no session
+ * rather than a torn one. A session only restores onto the model it was
+ * saved from (same config and the same first 4 KB of the model file).
+ */
+#define SESSION_MAGIC   0x53534c50   /* "PLSS" */
+#define SESSION_VERSION 1
+
+#ifndef SESSION_KV_TYPE
+#define SESSION_KV_TYPE WEIGHT_F16
+#endif
+
+typedef struct {
+    uint32_t magic;
+    int32_t version;
+    Config config;              /* seq_len after capping */
+    uint32_t model_crc;
+    int32_t pos;                /* next position to run */
+    int32_t token;              /* token to feed at pos */
+    int32_t n_slots;            /* KV slots saved */
+    int32_t kv_type;            /* WeightType of the saved cache */
+    unsigned long long rng_state;
+    float temperature;
+    float topp;
+    uint32_t payload_bytes;
+    uint32_t payload_crc;
+} SessionHeader;
+
+/**
+ * Write the session that continues at pos with token to flash, with the
+ * KV cache converted to kv_type (fp16 if the rows don't fit its groups).
+ * Returns the bytes stored, or negative on error.
+ */
+long session_save(const Transformer *t, const Sampler *sampler, int pos,
+                  int token, WeightType kv_type);
+
+/**
+ * Restore a saved session into t's KV cache and the sampler, and return
+ * where to continue in *pos and *token. Returns 0 on success, negative if
+ * there is no valid session for this model.
+ */
+int session_restore(Transformer *t, Sampler *sampler, int *pos, int *token);
+
+/** Drop the saved session. */
+void session_clear(void);
+
+/**
+ * Time re-running the prompt prefill for what session_restore() brought
+ * back, by replaying the saved tokens through forward(). This recomputes
+ * the cache exactly; restore again to continue from the saved copy.
+ * Returns microseconds, or 0 once the cache has rolled and the tokens
+ * can't be replayed at their positions.
+ */
+uint64_t session_reprefill_us(Transformer *t, int pos);
+
+#endif /* SESSION_H */
@@ -0,0 +1,98 @@
+#include "telemetry.h"
+#include <stdio.h>
+#include <string.h>
+
+static Histogram histograms[N_TELEM_METRICS];
+
+static const char *metric_names[N_TELEM_METRICS] = {
+    "prefill", "ttft", "decode", "write",
+};
+
+static int bucket_of(uint64_t us) {
+    if (us < 2) return 0;
+    int b = 63 - __builtin_clzll(us);
+    return b < TELEMETRY_BUCKETS ? b : TELEMETRY_BUCKETS - 1;
+}
+
+void telemetry_reset(void) {
+    memset(histograms, 0, sizeof(histograms));
+}
+
+void telemetry_record(TelemetryMetric m, uint64_t us) {
+    Histogram *h = &histograms[m];
+    h->counts[bucket_of(us)]++;
+    if (h->n == 0 || us < h->min_us) h->min_us = us;
+    if (us > h->max_us) h->max_us = us;
+    h->n++;
+    h->sum_us += us;
+}
+
+const Histogram *telemetry_histogram(TelemetryMetric m) {
+    return &histograms[m];
+}
+
+uint64_t telemetry_percentile(TelemetryMetric m, int pct) {
+    const Histogram *h = &histograms[m];
+    if (h->n == 0) return 0;
+    /* Rank of the sample, 1-based, rounded up */
+    uint64_t rank = ((uint64_t)h->n * pct + 99) / 100;
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            uint64_t upper = (uint64_t)2 << b;
+            return upper < h->max_us ? upper : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+/* Compact duration for bucket labels: 512us, 4ms, 2s */
+static void print_us(uint64_t us) {
+    if (us >= 1000000) printf("%llus", (unsigned long long)(us / 1000000));
+    else if (us >= 1000) printf("%llums", (unsigned long long)(us / 1000));
+    else printf("%lluus", (unsigned long long)us);
+}
+
+void telemetry_dump(void) {
+    printf("Telemetry: metric     n     mean      min      p50      p99"
+           "      max  (us)\n");
+    for (int m = 0; m < N_TELEM_METRICS; m++) {
+        const Histogram *h = &histograms[m];
+        if (h->n == 0) continue;
+        printf("Telemetry: %-7s %5u %8llu %8llu %8llu %8llu %8llu\n",
+               metric_names[m], (unsigned)h->n,
+               (unsigned long long)(h->sum_us / h->n),
+               (unsigned long long)h->min_us,
+               (unsigned long long)telemetry_percentile((TelemetryMetric)m, 50),
+               (unsigned long long)telemetry_percentile((TelemetryMetric)m, 99),
+               (unsigned long long)h->max_us);
+    }
+    for (int m = 0; m < N_TELEM_METRICS; m++) {
+        const Histogram *h = &histograms[m];
+        if (h->n == 0) continue;
+        printf("Telemetry: %-7s", metric_names[m]);
+        for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+            if (h->counts[b] == 0) continue;
+            printf(" <");
+            print_us((uint64_t)2 << b);
+            printf(":%u", (unsigned)h->counts[b]);
+        }
+        printf("\n");
+    }
+}
+
+int telemetry_command(int c) {
+    switch (c) {
+    case 't':
+        telemetry_dump();
+        return 1;
+    case 'r':
+        telemetry_reset();
+        printf("Telemetry: reset\n");
+        return 1;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+/*
+ * Latency histograms for generation. Buckets are powers of two in
+ * microseconds: bucket 0 holds 0-1 us, bucket i holds [2^i, 2^(i+1)) us,
+ * and the last bucket everything from ~16 s up. Fixed size, no allocation;
+ * recording is a clz and two adds.
+ */
+#define TELEMETRY_BUCKETS 25
+
+typedef enum {
+    TELEM_PREFILL = 0,  /* forward() over the prompt, per request */
+    TELEM_TTFT,         /* request start to first token handed out */
+    TELEM_DECODE,       /* forward() + sample(), tokens after the first */
+    TELEM_WRITE,        /* consumer callback per token (USB stalls) */
+    N_TELEM_METRICS
+} TelemetryMetric;
+
+typedef struct {
+    uint32_t counts[TELEMETRY_BUCKETS];
+    uint32_t n;
+    uint64_t sum_us;
+    uint64_t min_us;
+    uint64_t max_us;
+} Histogram;
+
+/** Clear all histograms (e.g. before a request). */
+void telemetry_reset(void);
+
+/** Add one sample of us microseconds to a metric. */
+void telemetry_record(TelemetryMetric m, uint64_t us);
+
+/** Read-only view of a metric's histogram. */
+const Histogram *telemetry_histogram(TelemetryMetric m);
+
+/**
+ * Upper bound of the bucket holding the pct-th percentile sample, capped
+ * at the observed maximum. 0 if the metric is empty.
+ */
+uint64_t telemetry_percentile(TelemetryMetric m, int pct);
+
+/** Print count, mean, min, p50, p99, max and non-empty buckets per metric. */
+void telemetry_dump(void);
+
+/**
+ * Serial query hook for the idle loop: 't' dumps the histograms, 'r'
+ * resets them. Returns 1 if the character was a telemetry command.
+ */
+int telemetry_command(int c);
+
+#endif /* TELEMETRY_H */
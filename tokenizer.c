@@ -3,45 +3,50 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
-
-/* Defined in model_data.h, included by main.c */
-extern const unsigned char models_tok512_bin[];
-extern const unsigned int models_tok512_bin_len;
+#include "transformer.h"
 
 /*
- * Static buffers — no malloc.
- * vocab_ptrs: array of char* pointing into the flash const array.
+ * Static buffers — no malloc. One MAX_VOCAB slot per tokenizer.
+ * vocab_ptrs: array of char* pointing into the string pool.
  * vocab_scores_buf: scores read from the binary.
  * sorted_vocab_buf: for BPE encode merge lookups.
  * str_buffer: scratch for encode().
  */
-#define MAX_VOCAB 512
+#define MAX_VOCAB MAX_VOCAB_SIZE
 
-static char *vocab_ptrs[MAX_VOCAB];
-static float vocab_scores_buf[MAX_VOCAB];
-static TokenIndex sorted_vocab_buf[MAX_VOCAB];
-static int sorted_vocab_ready = 0;
+static char *vocab_ptrs[MAX_TOKENIZERS * MAX_VOCAB];
+static float vocab_scores_buf[MAX_TOKENIZERS * MAX_VOCAB];
+static TokenIndex sorted_vocab_buf[MAX_TOKENIZERS * MAX_VOCAB];
+static int slots_used = 0;
 static char str_buffer[MAX_TOKEN_LENGTH * 2 + 3];
 
 /*
  * We can't point directly into the packed binary for strings because they
  * aren't null-terminated there. So we copy each token string into a static
- * pool in SRAM.
+ * pool in SRAM, shared by all tokenizers.
  */
-#define VOCAB_POOL_SIZE (MAX_VOCAB * (MAX_TOKEN_LENGTH + 1))
+#define VOCAB_POOL_SIZE (MAX_TOKENIZERS * MAX_VOCAB * (MAX_TOKEN_LENGTH + 1))
 static char vocab_pool[VOCAB_POOL_SIZE];
 static int vocab_pool_used = 0;
 
-int init_tokenizer(Tokenizer *t, int vocab_size) {
+int init_tokenizer(Tokenizer *t, const unsigned char *data, unsigned int size,
+                   int vocab_size) {
     if (vocab_size > MAX_VOCAB) {
         printf("Tokenizer: vocab_size %d exceeds MAX_VOCAB %d\n",
                vocab_size, MAX_VOCAB);
         return -1;
     }
+    if (slots_used == MAX_TOKENIZERS) {
+        printf("Tokenizer: all %d slots in use (raise MAX_TOKENIZERS)\n",
+               MAX_TOKENIZERS);
+        return -7;
+    }
+    int base = slots_used * MAX_VOCAB;
+    int pool_start = vocab_pool_used;
 
     t->vocab_size = vocab_size;
-    t->vocab = vocab_ptrs;
-    t->vocab_scores = vocab_scores_buf;
+    t->vocab = vocab_ptrs + base;
+    t->vocab_scores = vocab_scores_buf + base;
     t->sorted_vocab = NULL; /* built lazily on first encode() */
 
     /* Init byte_pieces for fallback single-byte decoding */
@@ -50,9 +55,9 @@ int init_tokenizer(Tokenizer *t, int vocab_size) {
         t->byte_pieces[i * 2 + 1] = '\0';
     }
 
-    /* Parse the tok512.bin binary from flash */
-    const unsigned char *ptr = models_tok512_bin;
-    const unsigned char *end = models_tok512_bin + models_tok512_bin_len;
+    /* Parse the tokenizer binary */
+    const unsigned char *ptr = data;
+    const unsigned char *end = data + size;
 
     /* First 4 bytes: max_token_length */
     if (ptr + 4 > end) return -2;
@@ -62,12 +67,10 @@ int init_tokenizer(Tokenizer *t, int vocab_size) {
     printf("Tokenizer: max_token_length=%u, loading %d tokens...\n",
            t->max_token_length, vocab_size);
 
-    vocab_pool_used = 0;
-
     for (int i = 0; i < vocab_size; i++) {
         /* score (float32) */
         if (ptr + sizeof(float) > end) return -3;
-        memcpy(&vocab_scores_buf[i], ptr, sizeof(float));
+        memcpy(&t->vocab_scores[i], ptr, sizeof(float));
         ptr += sizeof(float);
 
         /* len (int32) */
@@ -83,13 +86,14 @@ int init_tokenizer(Tokenizer *t, int vocab_size) {
         char *dest = vocab_pool + vocab_pool_used;
         memcpy(dest, ptr, len);
         dest[len] = '\0';
-        vocab_ptrs[i] = dest;
+        t->vocab[i] = dest;
         vocab_pool_used += len + 1;
         ptr += len;
     }
+    slots_used++;
 
     printf("Tokenizer: Loaded %d tokens (%d bytes in pool)\n",
-           vocab_size, vocab_pool_used);
+           vocab_size, vocab_pool_used - pool_start);
     return 0;
 }
 
@@ -134,16 +138,15 @@ void encode(Tokenizer *t, char *text, int8_t bos, int8_t eos,
         return;
     }
 
-    /* Build sorted vocab on first call */
-    if (!sorted_vocab_ready) {
+    /* Build sorted vocab on first call, in this tokenizer's slot */
+    if (t->sorted_vocab == NULL) {
+        TokenIndex *sorted = sorted_vocab_buf + (t->vocab - vocab_ptrs);
         for (int i = 0; i < t->vocab_size; i++) {
-            sorted_vocab_buf[i].str = t->vocab[i];
-            sorted_vocab_buf[i].id = i;
+            sorted[i].str = t->vocab[i];
+            sorted[i].id = i;
         }
-        qsort(sorted_vocab_buf, t->vocab_size, sizeof(TokenIndex),
-              compare_tokens);
-        t->sorted_vocab = sorted_vocab_buf;
-        sorted_vocab_ready = 1;
+        qsort(sorted, t->vocab_size, sizeof(TokenIndex), compare_tokens);
+        t->sorted_vocab = sorted;
     }
 
     size_t str_len = 0;
@@ -5,6 +5,13 @@
 
 #define MAX_TOKEN_LENGTH 128
 
+/* Tokenizers that can be resident at once (models.h shares one between
+   models with the same vocabulary). Each costs a MAX_VOCAB_SIZE slot of
+   the static tables and string pool. */
+#ifndef MAX_TOKENIZERS
+#define MAX_TOKENIZERS 1
+#endif
+
 typedef struct {
     char *str;
     int id;
@@ -20,10 +27,12 @@ typedef struct {
 } Tokenizer;
 
 /**
- * Initialise tokenizer from the embedded tok512.bin const array in flash.
- * Returns 0 on success.
+ * Initialise tokenizer from a llama2.c tokenizer binary of size bytes, e.g.
+ * the tok512.bin const array embedded in flash. data must outlive t. Takes
+ * one of the MAX_TOKENIZERS slots for good. Returns 0 on success.
  */
-int init_tokenizer(Tokenizer *t, int vocab_size);
+int init_tokenizer(Tokenizer *t, const unsigned char *data, unsigned int size,
+                   int vocab_size);
 
 /** Decode token id to string piece. */
 char *decode(Tokenizer *t, int prev_token, int token);
@@ -0,0 +1,340 @@
+/* bench.c - golden-logit regression check and performance benchmark
+ *
+ * Host build only (cmake -DPICO_LLAMA_HOST=ON builds it as bench):
+ *
+ *   ./bench model.bin tokenizer.bin --record golden.bin
+ *   ./bench model.bin tokenizer.bin --golden golden.bin --json out.json
+ *
+ * Runs a fixed set of prompts with a seeded sampler. --record stores every
+ * position's logits and the sampled tokens; --golden replays the stored
+ * tokens (teacher-forced, so one early mismatch can't cascade) and fails
+ * if any logit differs by more than --tol. Each run reports TTFT (prefill
+ * plus first sample), decode tok/s, per-token p50/p99 latency and memory,
+ * as text and optionally as JSON. Exit status is nonzero on a regression. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+#include "pico/time.h"
+#include "kernels.h"
+#include "psram.h"
+#include "transformer.h"
+#include "tokenizer.h"
+#include "sampler.h"
+
+#define GOLDEN_MAGIC   0x4c474c50   /* "PLGL" */
+#define GOLDEN_VERSION 1
+
+#define BENCH_STEPS 128
+#define BENCH_SEED  42
+
+static const char *prompts[] = {
+    "Once upon a time",
+    "Lily and Tom went to the park. They saw a big",
+    "The little dog was sad because",
+};
+#define N_PROMPTS ((int)(sizeof(prompts) / sizeof(prompts[0])))
+
+typedef struct {
+    int n_prompt;          /* prompt tokens, including BOS */
+    int n_pos;             /* forward() calls */
+    int tokens[MAX_SEQ_LEN + 1];
+    float *logits;         /* n_pos * vocab */
+} Trace;
+
+typedef struct {
+    uint64_t ttft_us;
+    uint64_t decode_us;
+    int n_decode;
+    uint64_t *token_us;    /* per decoded token */
+} Timing;
+
+static Transformer transformer;
+static Tokenizer tokenizer;
+static Sampler sampler;
+
+/* ---- Files ---- */
+
+static long read_file(const char *path, void *dst, size_t cap) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("bench: cannot open %s\n", path);
+        return -1;
+    }
+    size_t n = fread(dst, 1, cap, f);
+    fclose(f);
+    return (long)n;
+}
+
+static int write_golden(const char *path, Trace *traces, int vocab) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    uint32_t hdr[4] = { GOLDEN_MAGIC, GOLDEN_VERSION, N_PROMPTS, (uint32_t)vocab };
+    fwrite(hdr, sizeof(hdr), 1, f);
+    for (int p = 0; p < N_PROMPTS; p++) {
+        Trace *t = &traces[p];
+        fwrite(&t->n_prompt, sizeof(int), 1, f);
+        fwrite(&t->n_pos, sizeof(int), 1, f);
+        fwrite(t->tokens, sizeof(int), t->n_pos + 1, f);
+        fwrite(t->logits, sizeof(float), (size_t)t->n_pos * vocab, f);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int read_golden(const char *path, Trace *traces, int vocab) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    uint32_t hdr[4];
+    int ok = fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[0] == GOLDEN_MAGIC &&
+             hdr[1] == GOLDEN_VERSION && hdr[2] == N_PROMPTS &&
+             hdr[3] == (uint32_t)vocab;
+    for (int p = 0; ok && p < N_PROMPTS; p++) {
+        Trace *t = &traces[p];
+        ok = fread(&t->n_prompt, sizeof(int), 1, f) == 1 &&
+             fread(&t->n_pos, sizeof(int), 1, f) == 1 &&
+             t->n_pos > 0 && t->n_pos <= MAX_SEQ_LEN &&
+             fread(t->tokens, sizeof(int), t->n_pos + 1, f) ==
+                 (size_t)t->n_pos + 1;
+        if (!ok) break;
+        t->logits = malloc((size_t)t->n_pos * vocab * sizeof(float));
+        ok = t->logits &&
+             fread(t->logits, sizeof(float), (size_t)t->n_pos * vocab, f) ==
+                 (size_t)t->n_pos * vocab;
+    }
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/* ---- Runs ---- */
+
+/*
+ * One prompt: prefill, then sample up to steps tokens. With a golden
+ * trace the golden tokens are fed back instead of our own samples, and
+ * mismatches are counted.
+ */
+static void run_prompt(int p, int steps, Trace *out, const Trace *golden,
+                       Timing *tm, int *token_mismatch) {
+    int vocab = transformer.config.vocab_size;
+    int n_prompt = 0;
+    encode(&tokenizer, (char *)prompts[p], 1, 0, out->tokens, &n_prompt);
+    int n_pos = n_prompt - 1 + steps;
+    if (n_pos > transformer.config.seq_len) n_pos = transformer.config.seq_len;
+    if (golden) n_pos = golden->n_pos;
+    out->n_prompt = n_prompt;
+    out->n_pos = n_pos;
+
+    init_sampler(&sampler, vocab, 1.0f, 0.9f, BENCH_SEED + p);
+    tm->n_decode = 0;
+    *token_mismatch = 0;
+
+    uint64_t start = time_us_64(), last = start;
+    for (int pos = 0; pos < n_pos; pos++) {
+        float *logits = forward(&transformer, out->tokens[pos], pos);
+        if (out->logits) {
+            memcpy(out->logits + (size_t)pos * vocab, logits,
+                   vocab * sizeof(float));
+        }
+        if (pos < n_prompt - 1) continue;
+
+        int next = sample(&sampler, logits);
+        uint64_t now = time_us_64();
+        if (pos == n_prompt - 1) {
+            tm->ttft_us = now - start;
+        } else {
+            tm->token_us[tm->n_decode++] = now - last;
+        }
+        last = now;
+
+        if (golden) {
+            *token_mismatch += next != golden->tokens[pos + 1];
+            next = golden->tokens[pos + 1];
+        }
+        out->tokens[pos + 1] = next;
+    }
+    tm->decode_us = last - start - tm->ttft_us;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(uint64_t *sorted, int n, int pct) {
+    if (n == 0) return 0;
+    int i = (int)((int64_t)(n - 1) * pct / 100);
+    return sorted[i];
+}
+
+/* ---- Main ---- */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s model.bin tokenizer.bin [options]\n"
+            "  --record <file>  store golden logits\n"
+            "  --golden <file>  compare against stored golden logits\n"
+            "  --tol <float>    max abs logit difference (default 1e-4)\n"
+            "  --json <file>    write results as JSON\n"
+            "  --runs <int>     timed repetitions per prompt (default 3)\n"
+            "  --steps <int>    tokens to generate per prompt (default %d)\n",
+            prog, BENCH_STEPS);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *record = NULL, *golden_path = NULL, *json_path = NULL;
+    float tol = 1e-4f;
+    int runs = 3, steps = BENCH_STEPS;
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "--record") == 0) record = argv[++i];
+        else if (strcmp(argv[i], "--golden") == 0) golden_path = argv[++i];
+        else if (strcmp(argv[i], "--tol") == 0) tol = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0) json_path = argv[++i];
+        else if (strcmp(argv[i], "--runs") == 0) runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--steps") == 0) steps = atoi(argv[++i]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    if (psram_setup() != 0) return 1;
+    long model_bytes = read_file(argv[1], (void *)PSRAM_BASE, psram_size());
+    if (model_bytes <= 0 ||
+        init_transformer(&transformer, (uint8_t *)PSRAM_BASE) != 0) {
+        return 1;
+    }
+
+    static unsigned char tok_data[MAX_VOCAB_SIZE * (MAX_TOKEN_LENGTH + 8) + 4];
+    long tok_bytes = read_file(argv[2], tok_data, sizeof(tok_data));
+    int vocab = transformer.config.vocab_size;
+    if (tok_bytes <= 0 ||
+        init_tokenizer(&tokenizer, tok_data, (unsigned int)tok_bytes,
+                       vocab) != 0) {
+        return 1;
+    }
+
+    Trace golden[N_PROMPTS], trace[N_PROMPTS];
+    memset(golden, 0, sizeof(golden));
+    memset(trace, 0, sizeof(trace));
+    if (golden_path && read_golden(golden_path, golden, vocab) != 0) {
+        printf("bench: %s is not a golden file for this model\n", golden_path);
+        return 1;
+    }
+
+    Timing tm;
+    tm.token_us = malloc(sizeof(uint64_t) * MAX_SEQ_LEN);
+    uint64_t *all_token_us = malloc(sizeof(uint64_t) * MAX_SEQ_LEN *
+                                    N_PROMPTS * runs);
+    uint64_t ttft_us[N_PROMPTS] = { 0 };
+    uint64_t decode_us = 0;
+    int n_decode = 0, n_all = 0;
+    float max_diff[N_PROMPTS] = { 0 };
+    int mismatches[N_PROMPTS] = { 0 };
+    int regressions = 0;
+
+    for (int p = 0; p < N_PROMPTS; p++) {
+        const Trace *g = golden_path ? &golden[p] : NULL;
+
+        /* Untimed correctness pass; also warms caches */
+        trace[p].logits = malloc((size_t)MAX_SEQ_LEN * vocab * sizeof(float));
+        run_prompt(p, steps, &trace[p], g, &tm, &mismatches[p]);
+        if (g) {
+            for (size_t i = 0; i < (size_t)g->n_pos * vocab; i++) {
+                float d = fabsf(trace[p].logits[i] - g->logits[i]);
+                if (!(d <= max_diff[p])) max_diff[p] = d;
+            }
+            if (!(max_diff[p] <= tol)) regressions++;
+        }
+
+        /* Timed passes, without logit capture */
+        Trace timed = trace[p];
+        timed.logits = NULL;
+        for (int r = 0; r < runs; r++) {
+            int ignored;
+            run_prompt(p, steps, &timed, g, &tm, &ignored);
+            if (r == 0 || tm.ttft_us < ttft_us[p]) ttft_us[p] = tm.ttft_us;
+            decode_us += tm.decode_us;
+            n_decode += tm.n_decode;
+            memcpy(all_token_us + n_all, tm.token_us,
+                   tm.n_decode * sizeof(uint64_t));
+            n_all += tm.n_decode;
+        }
+    }
+
+    qsort(all_token_us, n_all, sizeof(uint64_t), cmp_u64);
+    double tok_s = decode_us ? n_decode * 1e6 / (double)decode_us : 0.0;
+    uint64_t p50 = percentile(all_token_us, n_all, 50);
+    uint64_t p99 = percentile(all_token_us, n_all, 99);
+    Config *c = &transformer.config;
+    size_t kv_dim = (size_t)c->dim * c->n_kv_heads / c->n_heads;
+    size_t kv_bytes = 2 * (size_t)c->n_layers * c->seq_len * kv_dim *
+                      sizeof(float);
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+
+    printf("\n=== Bench (%s kernels, %d runs) ===\n", kernels->name, runs);
+    for (int p = 0; p < N_PROMPTS; p++) {
+        printf("prompt %d: %3d prompt tokens, %3d positions, TTFT %6.2f ms",
+               p, trace[p].n_prompt, trace[p].n_pos, ttft_us[p] / 1000.0);
+        if (golden_path) {
+            printf(", max logit diff %.2e, %d token mismatches %s",
+                   (double)max_diff[p], mismatches[p],
+                   max_diff[p] <= tol ? "ok" : "REGRESSION");
+        }
+        printf("\n");
+    }
+    printf("decode: %.1f tok/s, p50 %llu us, p99 %llu us per token\n",
+           tok_s, (unsigned long long)p50, (unsigned long long)p99);
+    printf("memory: model %ld B, KV cache %u B, peak RSS %ld KB\n",
+           model_bytes, (unsigned)kv_bytes, ru.ru_maxrss);
+
+    if (json_path) {
+        FILE *f = fopen(json_path, "w");
+        if (!f) {
+            printf("bench: cannot write %s\n", json_path);
+            return 1;
+        }
+        fprintf(f, "{\n  \"kernels\": \"%s\",\n  \"runs\": %d,\n"
+                   "  \"steps\": %d,\n  \"prompts\": [\n",
+                kernels->name, runs, steps);
+        for (int p = 0; p < N_PROMPTS; p++) {
+            fprintf(f, "    {\"prompt_tokens\": %d, \"positions\": %d, "
+                       "\"ttft_ms\": %.3f",
+                    trace[p].n_prompt, trace[p].n_pos, ttft_us[p] / 1000.0);
+            if (golden_path) {
+                fprintf(f, ", \"max_logit_diff\": %.3e, "
+                           "\"token_mismatches\": %d, \"pass\": %s",
+                        (double)max_diff[p], mismatches[p],
+                        max_diff[p] <= tol ? "true" : "false");
+            }
+            fprintf(f, "}%s\n", p + 1 < N_PROMPTS ? "," : "");
+        }
+        fprintf(f, "  ],\n  \"decode_tok_s\": %.2f,\n"
+                   "  \"token_latency_us\": {\"p50\": %llu, \"p99\": %llu},\n"
+                   "  \"model_bytes\": %ld,\n  \"kv_cache_bytes\": %u,\n"
+                   "  \"peak_rss_kb\": %ld,\n  \"regressions\": %d\n}\n",
+                tok_s, (unsigned long long)p50, (unsigned long long)p99,
+                model_bytes, (unsigned)kv_bytes, ru.ru_maxrss, regressions);
+        fclose(f);
+    }
+
+    if (record) {
+        if (write_golden(record, trace, vocab) != 0) {
+            printf("bench: cannot write %s\n", record);
+            return 1;
+        }
+        printf("Recorded golden logits to %s\n", record);
+    }
+    return regressions ? 2 : 0;
+}
@@ -0,0 +1,151 @@
+/* exitcheck.c - evaluate early exit (adaptive depth) against full depth
+ *
+ * Host build only (cmake -DPICO_LLAMA_HOST=ON builds it as exitcheck):
+ *
+ *   ./exitcheck stories260K.bin [steps] [threshold ...]
+ *
+ * Generates a greedy sequence at full depth, then for each threshold
+ * (default 0.5 0.7 0.9 0.95 0.99) replays it teacher-forced with early
+ * exit on (EarlyExit in transformer.h, checks from (n_layers + 1) / 2). Reports
+ * the average layers run per token, the speedup of the replay over full
+ * depth, argmax agreement and mean KL divergence from the full-depth
+ * distributions, and how many tokens free-running greedy decoding with
+ * early exit matches the full-depth sequence for. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pico/time.h"
+#include "psram.h"
+#include "transformer.h"
+
+#define TIMING_RUNS 5
+
+static Transformer transformer;
+
+static int argmax(const float *x, int n) {
+    int best = 0;
+    for (int i = 1; i < n; i++) {
+        if (x[i] > x[best]) best = i;
+    }
+    return best;
+}
+
+/* log-softmax of x into out, in double precision */
+static void log_softmax(const float *x, double *out, int n) {
+    float max = x[argmax(x, n)];
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) sum += exp((double)x[i] - max);
+    double lse = max + log(sum);
+    for (int i = 0; i < n; i++) out[i] = x[i] - lse;
+}
+
+static int read_model(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("cannot open %s\n", path);
+        return -1;
+    }
+    size_t n = fread((void *)PSRAM_BASE, 1, psram_size(), f);
+    fclose(f);
+    return n > 0 ? 0 : -1;
+}
+
+/* Teacher-forced pass over tokens[0..steps); fastest of TIMING_RUNS */
+static uint64_t replay(const int *tokens, int steps, double *layers) {
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        long total = 0;
+        uint64_t t0 = time_us_64();
+        for (int pos = 0; pos < steps; pos++) {
+            forward(&transformer, tokens[pos], pos);
+            total += transformer.state.layers_run;
+        }
+        uint64_t us = time_us_64() - t0;
+        if (us < best) best = us;
+        *layers = (double)total / steps;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s model.bin [steps] [threshold ...]\n",
+                argv[0]);
+        return 1;
+    }
+    static const float default_thresholds[] = { 0.5f, 0.7f, 0.9f, 0.95f,
+                                                0.99f };
+    if (psram_setup() != 0 || read_model(argv[1]) != 0 ||
+        init_transformer(&transformer, (uint8_t *)PSRAM_BASE) != 0) {
+        return 1;
+    }
+    Config *p = &transformer.config;
+    int vocab = p->vocab_size;
+    int steps = argc > 2 ? atoi(argv[2]) : 0;
+    if (steps <= 0 || steps > p->seq_len) steps = p->seq_len;
+
+    double *full = malloc((size_t)steps * vocab * sizeof(double));
+    double *lp = malloc((size_t)vocab * sizeof(double));
+    int *tokens = malloc((size_t)(steps + 1) * sizeof(int));
+    if (!full || !lp || !tokens) return 1;
+
+    /* Full-depth greedy reference */
+    float threshold = transformer.early_exit.threshold;
+    transformer.early_exit.threshold = 0.0f;
+    tokens[0] = 1;
+    for (int pos = 0; pos < steps; pos++) {
+        float *logits = forward(&transformer, tokens[pos], pos);
+        log_softmax(logits, full + (size_t)pos * vocab, vocab);
+        tokens[pos + 1] = argmax(logits, vocab);
+    }
+    double full_layers;
+    uint64_t full_us = replay(tokens, steps, &full_layers);
+    printf("\nfull depth   %d layers, %d positions, %.2f ms\n",
+           p->n_layers, steps, full_us / 1000.0);
+    printf("threshold  layers/token  speedup  argmax  mean KL    "
+           "greedy match\n");
+
+    int n_thresholds = argc > 3 ? argc - 3 : (int)(sizeof(default_thresholds) /
+                                                   sizeof(float));
+    for (int i = 0; i < n_thresholds; i++) {
+        transformer.early_exit.threshold = argc > 3 ?
+            (float)atof(argv[3 + i]) : default_thresholds[i];
+
+        double layers;
+        uint64_t us = replay(tokens, steps, &layers);
+
+        /* Agreement with full depth, teacher-forced */
+        int same = 0;
+        double kl = 0.0;
+        for (int pos = 0; pos < steps; pos++) {
+            float *logits = forward(&transformer, tokens[pos], pos);
+            const double *ref = full + (size_t)pos * vocab;
+            log_softmax(logits, lp, vocab);
+            for (int k = 0; k < vocab; k++) {
+                kl += exp(ref[k]) * (ref[k] - lp[k]);
+            }
+            same += argmax(logits, vocab) == tokens[pos + 1];
+        }
+
+        /* Free-running greedy: tokens until the first divergence */
+        int match = 0, token = 1;
+        for (int pos = 0; pos < steps; pos++) {
+            token = argmax(forward(&transformer, token, pos), vocab);
+            if (token != tokens[pos + 1]) break;
+            match++;
+        }
+
+        printf("%9.4g  %12.2f  %6.2fx  %3d/%-3d %.3e  %d/%d\n",
+               (double)transformer.early_exit.threshold, layers,
+               us ? (double)full_us / us : 0.0, same, steps, kl / steps,
+               match, steps);
+    }
+    transformer.early_exit.threshold = threshold;
+
+    free(full);
+    free(lp);
+    free(tokens);
+    return 0;
+}
@@ -0,0 +1,71 @@
+/* kernelcheck.c - check every SIMD kernel backend against scalar
+ *
+ * Host build only (cmake -DPICO_LLAMA_HOST=ON builds it as kernelcheck):
+ *
+ *   ./kernelcheck
+ *
+ * kernels_init() checks the backend it picks at one shape and quietly
+ * falls back to scalar if it disagrees. This runs kernels_check() for
+ * each backend built into the binary over a range of shapes (single
+ * groups, odd rows, SIMD tails, full attention windows) and exits
+ * non-zero if any of them is out of KERNELS_CHECK_TOLERANCE, so a
+ * regression fails the run instead. Backends the CPU does not support
+ * are reported and skipped. */
+
+#include <stdio.h>
+#include "kernels.h"
+
+typedef struct {
+    int n, d, t, head_size;
+} Shape;
+
+static const Shape shapes[] = {
+    { 96, 13, 37, 19 },     /* the startup check */
+    { 32, 1, 1, 1 },
+    { 32, 2, 3, 5 },
+    { 64, 7, 64, 64 },
+    { 128, 16, 127, 8 },
+    { 160, 5, 33, 47 },
+    { 256, 32, 256, 3 },
+    { 256, 31, 255, 255 },
+};
+
+int main(void) {
+    struct {
+        const char *name;
+        const Kernels *k;
+    } backends[] = {
+        { "avx2", kernels_avx2() },
+        { "neon", kernels_neon() },
+    };
+    int n_shapes = (int)(sizeof(shapes) / sizeof(shapes[0]));
+    int checked = 0, failed = 0;
+
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        const Kernels *k = backends[b].k;
+        if (!k) {
+            printf("%-5s not built in or not supported, skipped\n",
+                   backends[b].name);
+            continue;
+        }
+        float worst = 0.0f;
+        for (int i = 0; i < n_shapes; i++) {
+            const Shape *s = &shapes[i];
+            float err = kernels_check(k, s->n, s->d, s->t, s->head_size);
+            if (err > KERNELS_CHECK_TOLERANCE) {
+                printf("%-5s n=%d d=%d t=%d head_size=%d: rel err %.2e  "
+                       "FAIL\n", k->name, s->n, s->d, s->t, s->head_size,
+                       (double)err);
+                failed++;
+            }
+            if (err > worst) worst = err;
+        }
+        printf("%-5s %d shapes, worst rel err vs scalar %.2e (bound %.0e)"
+               "  %s\n", k->name, n_shapes, (double)worst,
+               (double)KERNELS_CHECK_TOLERANCE,
+               worst <= KERNELS_CHECK_TOLERANCE ? "ok" : "FAIL");
+        checked++;
+    }
+    if (checked == 0) printf("no SIMD backend to check\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+/* loadcheck.c - boot-to-first-token with the blocking and pipelined loaders
+ *
+ * Host build only (cmake -DPICO_LLAMA_HOST=ON builds it as loadcheck):
+ *
+ *   ./loadcheck stories15M.bin [MB/s] [prompt_tokens]
+ *
+ * Holds the model file in host memory as a stand-in for flash and loads
+ * it into PSRAM twice at the emulated flash rate (default
+ * LOADER_HOST_MBPS): once copying it all before init_transformer(), once
+ * streamed layer by layer (loader.h) with forward() running behind the
+ * copy. Each then prefills a fixed prompt of prompt_tokens positions
+ * from BOS (default 5) the way gen_step() does: one forward() per
+ * position, or forward_batch() layer by layer while the model is still
+ * streaming in. Reports when the first token's logits came out, when the
+ * copy finished and how long forward() waited for layers. The two runs'
+ * logits must agree to within TOLERANCE (batched and single-position
+ * matmuls round differently). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/time.h"
+#include "psram.h"
+#include "psram_alloc.h"
+#include "placement.h"
+#include "loader.h"
+
+#define TOLERANCE 1e-4f
+
+static Transformer transformer;
+static ModelStream stream;
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("cannot open %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = n > 0 ? malloc((size_t)n) : NULL;
+    if (!data || fread(data, 1, (size_t)n, f) != (size_t)n) {
+        printf("cannot read %s\n", path);
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    *size = (size_t)n;
+    return data;
+}
+
+typedef struct {
+    uint64_t first_token_us;
+    uint64_t copied_us;
+    uint64_t wait_us;
+} LoadTiming;
+
+/* Load flash into PSRAM, blocking or streamed, and run the prompt. The
+   logits of the first token go to logits. */
+static int run(const uint8_t *flash, size_t size, int pipelined,
+               int prompt, float *logits, LoadTiming *timing) {
+    uint8_t *region = psram_alloc(size, pipelined ? "pipelined" :
+                                  "blocking");
+    if (region == NULL) return -1;
+    memset(&transformer, 0, sizeof(transformer));
+
+    uint64_t t0 = time_us_64();
+    if (pipelined) {
+        loader_init(&stream, flash, region, size);
+        transformer.loading = &stream;
+    } else {
+        loader_copy(region, flash, size);
+        timing->copied_us = time_us_64() - t0;
+    }
+    if (init_transformer(&transformer, region) != 0) {
+        if (pipelined && stream.n_stages) {
+            loader_wait(&stream, stream.n_stages - 1);
+        }
+        psram_free(region);
+        return -1;
+    }
+
+    /* Any fixed tokens do; both runs see the same ones */
+    Config *p = &transformer.config;
+    int tokens[MAX_SEQ_LEN];
+    for (int i = 0; i < prompt; i++) {
+        tokens[i] = i ? (i * 97) % p->vocab_size : 1;
+    }
+    int pos = 0;
+    while (transformer.loading && pos < prompt - 1) {
+        int n = prompt - 1 - pos < MAX_BATCH ? prompt - 1 - pos : MAX_BATCH;
+        if (!forward_batch(&transformer, tokens + pos, n, pos)) break;
+        pos += n;
+    }
+    float *out = NULL;
+    for (; pos < prompt; pos++) out = forward(&transformer, tokens[pos], pos);
+    timing->first_token_us = time_us_64() - t0;
+    memcpy(logits, out, p->vocab_size * sizeof(float));
+
+    if (pipelined) {
+        finish_transformer_load(&transformer);
+        timing->copied_us = stream.stage_us[stream.n_stages - 1];
+        timing->wait_us = stream.wait_us;
+        loader_print(&stream);
+    } else {
+        timing->wait_us = 0;
+    }
+    placement_unpin(&transformer);
+    psram_free(region);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s model.bin [MB/s] [prompt_tokens]\n",
+                argv[0]);
+        return 1;
+    }
+    if (argc > 2) loader_host_mbps = atoi(argv[2]);
+    int prompt = argc > 3 ? atoi(argv[3]) : 5;
+    if (prompt < 1) prompt = 1;
+    if (prompt > MAX_SEQ_LEN) prompt = MAX_SEQ_LEN;
+
+    size_t size;
+    uint8_t *flash = read_file(argv[1], &size);
+    if (flash == NULL || psram_setup() != 0) return 1;
+
+    static float logits[2][MAX_VOCAB_SIZE];
+    LoadTiming timing[2];
+    for (int mode = 0; mode < 2; mode++) {
+        printf("\n=== %s loader ===\n", mode ? "Pipelined" : "Blocking");
+        if (run(flash, size, mode, prompt, logits[mode], &timing[mode])) {
+            return 1;
+        }
+    }
+
+    int vocab = transformer.config.vocab_size;
+    float max_diff = 0.0f;
+    for (int i = 0; i < vocab; i++) {
+        float d = logits[0][i] - logits[1][i];
+        if (d < 0) d = -d;
+        if (d > max_diff) max_diff = d;
+    }
+
+    printf("\n%u bytes at %d MB/s, %d prompt positions\n", (unsigned)size,
+           loader_host_mbps, prompt);
+    printf("loader     first token ms  copy done ms  waited ms\n");
+    for (int mode = 0; mode < 2; mode++) {
+        printf("%-9s  %14.1f  %12.1f  %9.1f\n",
+               mode ? "pipelined" : "blocking",
+               timing[mode].first_token_us / 1000.0,
+               timing[mode].copied_us / 1000.0,
+               timing[mode].wait_us / 1000.0);
+    }
+    printf("speedup %.2fx, first-token logits max_diff=%.2e\n",
+           timing[1].first_token_us ?
+           (double)timing[0].first_token_us / timing[1].first_token_us : 0.0,
+           (double)max_diff);
+    free(flash);
+    return max_diff <= TOLERANCE ? 0 : 1;
+}
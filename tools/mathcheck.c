@@ -0,0 +1,161 @@
+/* mathcheck.c - accuracy check for the fastmath.h approximations
+ *
+ * Host build only (cmake -DPICO_LLAMA_HOST=ON builds it as mathcheck):
+ *
+ *   ./mathcheck                       sweep each function against libm
+ *   ./mathcheck stories260K.bin 256   ... and compare a model end to end
+ *
+ * The sweeps compare each approximation with a double-precision reference
+ * and fail if any error exceeds the bound documented in fastmath.h. With a
+ * model, a greedy sequence is generated with the exact scalar kernels, then
+ * replayed (teacher-forced) through kernels_fast. The tool reports the
+ * logit drift per position, how often argmax agrees, and how often a seeded
+ * top-p sampler draws the same token from both sets of logits. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fastmath.h"
+#include "kernels.h"
+#include "psram.h"
+#include "transformer.h"
+#include "sampler.h"
+
+#define EXP_BOUND   1.5e-7
+#define RSQRT_BOUND 5e-6
+#define SILU_BOUND  3e-7
+
+static int report(const char *name, double err, double at, double bound) {
+    int ok = err <= bound;
+    printf("%-12s max rel err %.3e at %-12g bound %.1e  %s\n",
+           name, err, at, bound, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static int sweep(void) {
+    double worst = 0.0, at = 0.0;
+    for (float x = -87.3f; x < 88.3f; x += 1e-6f * (1.0f + fabsf(x))) {
+        double ref = exp((double)x);
+        double e = fabs(fast_expf(x) - ref) / ref;
+        if (e > worst) { worst = e; at = x; }
+    }
+    int ok = report("fast_expf", worst, at, EXP_BOUND);
+    if (fast_expf(-INFINITY) != 0.0f || fast_expf(-100.0f) != 0.0f) {
+        printf("fast_expf    does not flush to 0 below the range  FAIL\n");
+        ok = 0;
+    }
+
+    worst = 0.0;
+    for (float x = 1.2e-38f; x < 3e38f; x *= 1.00001f) {
+        double ref = 1.0 / sqrt((double)x);
+        double e = fabs(fast_rsqrtf(x) - ref) / ref;
+        if (e > worst) { worst = e; at = x; }
+    }
+    ok &= report("fast_rsqrtf", worst, at, RSQRT_BOUND);
+
+    worst = 0.0;
+    for (float x = -80.0f; x < 80.0f; x += 1e-5f) {
+        double ref = x / (1.0 + exp(-(double)x));
+        if (fabs(ref) < 1e-30) continue;
+        double e = fabs(fast_silu(x) - ref) / fabs(ref);
+        if (e > worst) { worst = e; at = x; }
+    }
+    ok &= report("fast_silu", worst, at, SILU_BOUND);
+    return ok;
+}
+
+static int argmax(const float *x, int n) {
+    int best = 0;
+    for (int i = 1; i < n; i++) {
+        if (x[i] > x[best]) best = i;
+    }
+    return best;
+}
+
+static int read_model(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("cannot open %s\n", path);
+        return -1;
+    }
+    size_t n = fread((void *)PSRAM_BASE, 1, psram_size(), f);
+    fclose(f);
+    return n > 0 ? 0 : -1;
+}
+
+static Transformer transformer;
+
+static int end_to_end(const char *path, int steps) {
+    if (psram_setup() != 0 || read_model(path) != 0 ||
+        init_transformer(&transformer, (uint8_t *)PSRAM_BASE) != 0) {
+        return 0;
+    }
+    int vocab = transformer.config.vocab_size;
+    if (steps <= 0 || steps > transformer.config.seq_len) {
+        steps = transformer.config.seq_len;
+    }
+
+    float *exact = malloc((size_t)steps * vocab * sizeof(float));
+    float *fast = malloc((size_t)vocab * sizeof(float));
+    int *tokens = malloc((size_t)(steps + 1) * sizeof(int));
+    if (!exact || !fast || !tokens) return 0;
+
+    /* Greedy reference sequence with libm math */
+    kernels = &kernels_scalar;
+    tokens[0] = 1;
+    for (int pos = 0; pos < steps; pos++) {
+        float *logits = forward(&transformer, tokens[pos], pos);
+        memcpy(exact + (size_t)pos * vocab, logits, vocab * sizeof(float));
+        tokens[pos + 1] = argmax(logits, vocab);
+    }
+
+    Sampler s_exact, s_fast;
+    init_sampler(&s_exact, vocab, 1.0f, 0.9f, 1234);
+    init_sampler(&s_fast, vocab, 1.0f, 0.9f, 1234);
+
+    float max_drift = 0.0f, max_range = 0.0f;
+    int argmax_same = 0, sample_same = 0;
+    for (int pos = 0; pos < steps; pos++) {
+        kernels = &kernels_fast;
+        memcpy(fast, forward(&transformer, tokens[pos], pos),
+               vocab * sizeof(float));
+
+        float *ref = exact + (size_t)pos * vocab;
+        float lo = ref[0], hi = ref[0];
+        for (int i = 0; i < vocab; i++) {
+            float d = fabsf(fast[i] - ref[i]);
+            if (d > max_drift) max_drift = d;
+            if (ref[i] < lo) lo = ref[i];
+            if (ref[i] > hi) hi = ref[i];
+        }
+        if (hi - lo > max_range) max_range = hi - lo;
+        argmax_same += argmax(fast, vocab) == argmax(ref, vocab);
+
+        /* sample() softmaxes in place with the active kernels */
+        int t_fast = sample(&s_fast, fast);
+        kernels = &kernels_scalar;
+        int t_exact = sample(&s_exact, ref);
+        sample_same += t_fast == t_exact;
+    }
+
+    printf("end-to-end   %d positions: max logit drift %.3e "
+           "(logit range %.2f)\n", steps, (double)max_drift,
+           (double)max_range);
+    printf("end-to-end   argmax agreement %d/%d, "
+           "sampled-token agreement %d/%d (T=1, top-p 0.9)\n",
+           argmax_same, steps, sample_same, steps);
+
+    free(exact);
+    free(fast);
+    free(tokens);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int ok = sweep();
+    if (argc > 1) {
+        ok &= end_to_end(argv[1], argc > 2 ? atoi(argv[2]) : 0);
+    }
+    return ok ? 0 : 1;
+}
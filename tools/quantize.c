@@ -0,0 +1,284 @@
+/* quantize.c - convert a llama2.c fp32 model into a PLMA model file
+ *
+ * Runs on the host, reusing the device's conversion code:
+ *
+ *   cc -O2 -I. tools/quantize.c weights.c kernels.c -lm -o quantize
+ *   ./quantize stories15M.bin stories15M_q4.bin --attn q4 --ffn q4 --emb q4
+ *   ./quantize stories15M.bin stories15M_s8.bin --ffn s8 --prune 0.25
+ *
+ * Per-tensor formats are f32, f16, bf16, q4, q8 or s8 (default f32);
+ * rmsnorm weights stay fp32. s8 prunes to 2:4 sparsity; --prune also
+ * zeroes that fraction of each s8 tensor's groups, lowest L2 norm first,
+ * which the kernels then skip. Prints the error of every tensor, the
+ * bytes streamed and scalar matmul time per token against fp32, and the
+ * resulting file size against the board's flash and PSRAM.
+ *
+ * Accuracy is reported per tensor only (max_err, rel_rms against the
+ * fp32 weights), not for the model as a whole. For that, compare the
+ * perplexity of both files on the same text with the host tool's -f
+ * option (score.h). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "transformer.h"
+
+#define FLASH_BYTES (16u << 20)
+#define PSRAM_BYTES (8u << 20)
+
+static const char *matrix_names[N_WEIGHT_MATRICES] = {
+    "embedding", "wq", "wk", "wv", "wo", "w1", "w2", "w3", "wcls",
+};
+
+/* Per-token cost of the matrices written so far, and of them in fp32 */
+static size_t token_bytes, token_bytes_f32;
+static double token_us, token_us_f32;
+static float prune_fraction;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void add_error(WeightError *err, float ref, float got) {
+    float e = fabsf(ref - got);
+    if (e > err->max_abs) err->max_abs = e;
+    err->sum_sq_err += (double)e * e;
+    err->sum_sq_ref += (double)ref * ref;
+}
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Copy of src with the prune_fraction of S8 groups with the smallest L2
+ * norm zeroed. The zeroed values go into err; *pruned counts the groups.
+ */
+static float *prune_groups(const float *src, size_t n, WeightError *err,
+                           size_t *pruned) {
+    size_t groups = n / S8_GROUP_SIZE;
+    float *out = malloc(n * sizeof(float));
+    float *norms = malloc(groups * sizeof(float));
+    float *sorted = malloc(groups * sizeof(float));
+    memcpy(out, src, n * sizeof(float));
+    for (size_t g = 0; g < groups; g++) {
+        double ss = 0.0;
+        for (int k = 0; k < S8_GROUP_SIZE; k++) {
+            ss += (double)src[g * S8_GROUP_SIZE + k] * src[g * S8_GROUP_SIZE + k];
+        }
+        norms[g] = sorted[g] = (float)ss;
+    }
+    qsort(sorted, groups, sizeof(float), compare_floats);
+    size_t target = (size_t)(prune_fraction * groups);
+    *pruned = 0;
+    for (size_t g = 0; g < groups && target > 0; g++) {
+        if (norms[g] > sorted[target - 1] || *pruned == target) continue;
+        for (int k = 0; k < S8_GROUP_SIZE; k++) {
+            add_error(err, src[g * S8_GROUP_SIZE + k], 0.0f);
+            out[g * S8_GROUP_SIZE + k] = 0.0f;
+        }
+        (*pruned)++;
+    }
+    free(norms);
+    free(sorted);
+    return out;
+}
+
+/*
+ * Scalar matmul time over every row of a converted matrix (all layers),
+ * as one token's worth of that matrix would take with the Pico's kernels.
+ */
+static double time_matmul(const WeightTensor *w, int row_len, size_t rows) {
+    float *x = malloc(row_len * sizeof(float));
+    float *out = malloc(rows * sizeof(float));
+    for (int i = 0; i < row_len; i++) x[i] = (float)((i * 37) % 17) / 17.0f;
+    int reps = 0;
+    double t0 = now_us(), t;
+    do {
+        weight_matmul(out, x, w, 0, row_len, (int)rows);
+        reps++;
+        t = now_us() - t0;
+    } while (t < 20000.0);
+    free(x);
+    free(out);
+    return t / reps;
+}
+
+static int parse_type(const char *s, uint8_t *type) {
+    for (int t = 0; t < N_WEIGHT_TYPES; t++) {
+        if (strcmp(s, weight_type_name((WeightType)t)) == 0) {
+            *type = (uint8_t)t;
+            return 0;
+        }
+    }
+    fprintf(stderr, "unknown weight type '%s'\n", s);
+    return -1;
+}
+
+static void write_padded(FILE *f, const void *data, size_t bytes) {
+    static const uint8_t zeros[4] = { 0 };
+    fwrite(data, 1, bytes, f);
+    fwrite(zeros, 1, (4 - bytes % 4) % 4, f);
+}
+
+static void write_floats(FILE *f, const float **src, size_t n) {
+    write_padded(f, *src, n * sizeof(float));
+    *src += n;
+}
+
+static void write_matrix(FILE *f, const float **src, ModelHeader *hdr,
+                         WeightMatrix m, size_t n, int row_len) {
+    uint8_t type = hdr->types[m];
+    if (!weight_row_ok((WeightType)type, row_len)) {
+        printf("%-9s rows of %d don't fit %s groups, using f16\n",
+               matrix_names[m], row_len, weight_type_name((WeightType)type));
+        type = hdr->types[m] = WEIGHT_F16;
+    }
+
+    void *buf = malloc(weight_bytes((WeightType)type, n));
+    WeightError err = { 0 };
+    const float *values = *src;
+    float *pruned_values = NULL;
+    size_t pruned = 0;
+    if (type == WEIGHT_S8 && prune_fraction > 0.0f) {
+        values = pruned_values = prune_groups(*src, n, &err, &pruned);
+    }
+    size_t bytes = weight_convert(buf, values, n, (WeightType)type, &err);
+    write_padded(f, buf, bytes);
+
+    /* Every row but the embedding's is streamed once per token, and the
+       embedding's too when it doubles as the classifier; pruned groups
+       cost only their scale */
+    if (m != WM_EMBEDDING || hdr->shared_classifier) {
+        WeightTensor wt = { buf, (WeightType)type };
+        WeightTensor wf = { (void *)*src, WEIGHT_F32 };
+        token_bytes += bytes - pruned * (sizeof(BlockS8) - sizeof(uint16_t));
+        token_bytes_f32 += n * sizeof(float);
+        token_us += time_matmul(&wt, row_len, n / row_len);
+        token_us_f32 += time_matmul(&wf, row_len, n / row_len);
+    }
+    free(buf);
+    free(pruned_values);
+    *src += n;
+
+    double rel = err.sum_sq_ref > 0.0 ? sqrt(err.sum_sq_err / err.sum_sq_ref) : 0.0;
+    printf("%-9s %-4s %10zu bytes  max_err=%.2e rel_rms=%.2e",
+           matrix_names[m], weight_type_name((WeightType)type), bytes,
+           (double)err.max_abs, rel);
+    if (pruned) {
+        printf("  pruned %zu/%zu groups", pruned, n / S8_GROUP_SIZE);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s in.bin out.bin [--emb T] [--attn T] "
+                "[--ffn T] [--cls T] [--prune F]\n", argv[0]);
+        return 1;
+    }
+
+    ModelHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = MODEL_MAGIC;
+    hdr.version = MODEL_VERSION;
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--prune") == 0) {
+            prune_fraction = (float)atof(argv[i + 1]);
+            if (prune_fraction < 0.0f || prune_fraction >= 1.0f) {
+                fprintf(stderr, "--prune takes a fraction in [0, 1)\n");
+                return 1;
+            }
+            continue;
+        }
+        uint8_t type;
+        if (parse_type(argv[i + 1], &type) != 0) return 1;
+        if (strcmp(argv[i], "--emb") == 0) {
+            hdr.types[WM_EMBEDDING] = type;
+        } else if (strcmp(argv[i], "--attn") == 0) {
+            hdr.types[WM_WQ] = hdr.types[WM_WK] = type;
+            hdr.types[WM_WV] = hdr.types[WM_WO] = type;
+        } else if (strcmp(argv[i], "--ffn") == 0) {
+            hdr.types[WM_W1] = hdr.types[WM_W2] = hdr.types[WM_W3] = type;
+        } else if (strcmp(argv[i], "--cls") == 0) {
+            hdr.types[WM_CLASSIFIER] = type;
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) { perror(argv[1]); return 1; }
+    fseek(in, 0, SEEK_END);
+    long in_size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    uint8_t *blob = malloc(in_size);
+    if (!blob || fread(blob, 1, in_size, in) != (size_t)in_size) {
+        fprintf(stderr, "failed to read %s\n", argv[1]);
+        return 1;
+    }
+    fclose(in);
+
+    Config *p = &hdr.config;
+    memcpy(p, blob, sizeof(Config));
+    hdr.shared_classifier = p->vocab_size > 0;
+    p->vocab_size = abs(p->vocab_size);
+
+    size_t dim = p->dim;
+    size_t layers = p->n_layers;
+    size_t head_size = dim / p->n_heads;
+    size_t kv_dim = p->n_kv_heads * head_size;
+    size_t hidden_dim = p->hidden_dim;
+    size_t vocab = p->vocab_size;
+    printf("dim=%zu hidden=%zu layers=%zu heads=%d kv_heads=%d vocab=%zu "
+           "seq_len=%d shared=%d\n", dim, hidden_dim, layers, p->n_heads,
+           p->n_kv_heads, vocab, p->seq_len, hdr.shared_classifier);
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out) { perror(argv[2]); return 1; }
+    uint8_t header[MODEL_HEADER_SIZE] = { 0 };
+    fwrite(header, 1, sizeof(header), out);
+
+    const float *src = (const float *)(blob + sizeof(Config));
+    write_matrix(out, &src, &hdr, WM_EMBEDDING, vocab * dim, dim);
+    /* After the write: it may have fallen back to f16 */
+    if (hdr.shared_classifier) hdr.types[WM_CLASSIFIER] = hdr.types[WM_EMBEDDING];
+    write_floats(out, &src, layers * dim);
+    write_matrix(out, &src, &hdr, WM_WQ, layers * dim * dim, dim);
+    write_matrix(out, &src, &hdr, WM_WK, layers * dim * kv_dim, dim);
+    write_matrix(out, &src, &hdr, WM_WV, layers * dim * kv_dim, dim);
+    write_matrix(out, &src, &hdr, WM_WO, layers * dim * dim, dim);
+    write_floats(out, &src, layers * dim);
+    write_matrix(out, &src, &hdr, WM_W1, layers * dim * hidden_dim, dim);
+    write_matrix(out, &src, &hdr, WM_W2, layers * hidden_dim * dim, hidden_dim);
+    write_matrix(out, &src, &hdr, WM_W3, layers * dim * hidden_dim, dim);
+    write_floats(out, &src, dim);
+    if (!hdr.shared_classifier) {
+        src += p->seq_len * head_size;  /* freq_cis_real + freq_cis_imag */
+        write_matrix(out, &src, &hdr, WM_CLASSIFIER, vocab * dim, dim);
+    }
+
+    long out_size = ftell(out);
+    memcpy(header, &hdr, sizeof(hdr));
+    fseek(out, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), out);
+    fclose(out);
+    free(blob);
+
+    printf("per token: %zu bytes streamed (%.1f%% of fp32), scalar matmuls "
+           "%.0f us (%.2fx fp32)\n", token_bytes,
+           100.0 * token_bytes / token_bytes_f32, token_us,
+           token_us / token_us_f32);
+    printf("%ld -> %ld bytes (%.1f%%)  flash: %s  PSRAM: %s\n",
+           in_size, out_size, 100.0 * out_size / in_size,
+           out_size <= FLASH_BYTES ? "fits" : "TOO LARGE",
+           out_size <= PSRAM_BYTES ? "fits" : "TOO LARGE");
+    return 0;
+}
@@ -1,8 +1,13 @@
 #include "transformer.h"
 #include "psram.h"
+#include "placement.h"
+#include "kernels.h"
+#include "kvpage.h"
+#include "loader.h"
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
+#include "pico/time.h"
 
 /* ---- Static RunState buffers in SRAM (.bss) ---- */
 static float rs_x[MAX_DIM];
@@ -11,52 +16,329 @@ static float rs_xb2[MAX_DIM];
 static float rs_hb[MAX_HIDDEN_DIM];
 static float rs_hb2[MAX_HIDDEN_DIM];
 static float rs_q[MAX_DIM];
+static float rs_q_sink[MAX_DIM];
 static float rs_att[MAX_N_HEADS * MAX_SEQ_LEN];
 static float rs_logits[MAX_VOCAB_SIZE];
 static float rs_key_cache[MAX_N_LAYERS * MAX_SEQ_LEN * MAX_KV_DIM];
 static float rs_value_cache[MAX_N_LAYERS * MAX_SEQ_LEN * MAX_KV_DIM];
+static int rs_kv_tokens[MAX_SEQ_LEN];
+
+/* ---- Batch activations for forward_batch(), one row per position ---- */
+static float bs_x[MAX_BATCH * MAX_DIM];
+static float bs_xb[MAX_BATCH * MAX_DIM];
+static float bs_xb2[MAX_BATCH * MAX_DIM];
+static float bs_q[MAX_BATCH * MAX_DIM];
+static float bs_hb[MAX_BATCH * MAX_HIDDEN_DIM];
+static float bs_hb2[MAX_BATCH * MAX_HIDDEN_DIM];
+static float bs_row[MAX_HIDDEN_DIM > MAX_DIM ? MAX_HIDDEN_DIM : MAX_DIM];
 
 /* ---- Weight pointer mapping ---- */
 
-static void memory_map_weights(TransformerWeights *w, Config *p, float *ptr,
-                               int shared_weights) {
-    int head_size = p->dim / p->n_heads;
-    int n_layers = p->n_layers;
-    w->token_embedding_table = ptr;
-    ptr += p->vocab_size * p->dim;
-    w->rms_att_weight = ptr;
-    ptr += n_layers * p->dim;
-    w->wq = ptr;
-    ptr += n_layers * p->dim * (p->n_heads * head_size);
-    w->wk = ptr;
-    ptr += n_layers * p->dim * (p->n_kv_heads * head_size);
-    w->wv = ptr;
-    ptr += n_layers * p->dim * (p->n_kv_heads * head_size);
-    w->wo = ptr;
-    ptr += n_layers * (p->n_heads * head_size) * p->dim;
-    w->rms_ffn_weight = ptr;
-    ptr += n_layers * p->dim;
-    w->w1 = ptr;
-    ptr += n_layers * p->dim * p->hidden_dim;
-    w->w2 = ptr;
-    ptr += n_layers * p->hidden_dim * p->dim;
-    w->w3 = ptr;
-    ptr += n_layers * p->dim * p->hidden_dim;
-    w->rms_final_weight = ptr;
-    ptr += p->dim;
-    /* skip freq_cis_real and freq_cis_imag */
-    ptr += p->seq_len * head_size / 2;
-    ptr += p->seq_len * head_size / 2;
-    w->wcls = shared_weights ? w->token_embedding_table : ptr;
+static uint8_t *align4(uint8_t *p) {
+    return (uint8_t *)(((uintptr_t)p + 3) & ~(uintptr_t)3);
+}
+
+static float *map_floats(uint8_t **ptr, size_t n) {
+    float *f = (float *)*ptr;
+    *ptr += n * sizeof(float);
+    return f;
+}
+
+static WeightTensor map_matrix(uint8_t **ptr, const uint8_t *types,
+                               WeightMatrix m, size_t n) {
+    WeightTensor t = { .data = *ptr, .type = (WeightType)types[m] };
+    *ptr = align4(*ptr + weight_bytes(t.type, n));
+    return t;
+}
+
+/*
+ * Walk the tensors in file order. Legacy files are all fp32 and still
+ * carry the freq_cis tables before an unshared classifier. Returns the end
+ * of the tensor data.
+ */
+static uint8_t *memory_map_weights(TransformerWeights *w, Config *p,
+                                   uint8_t *ptr, const uint8_t *types,
+                                   int shared_weights, int legacy) {
+    size_t head_size = p->dim / p->n_heads;
+    size_t n_layers = p->n_layers;
+    size_t dim = p->dim;
+    size_t kv_dim = p->n_kv_heads * head_size;
+    size_t hidden_dim = p->hidden_dim;
+    w->token_embedding_table = map_matrix(&ptr, types, WM_EMBEDDING,
+                                          p->vocab_size * dim);
+    w->rms_att_weight = map_floats(&ptr, n_layers * dim);
+    w->wq = map_matrix(&ptr, types, WM_WQ, n_layers * dim * dim);
+    w->wk = map_matrix(&ptr, types, WM_WK, n_layers * dim * kv_dim);
+    w->wv = map_matrix(&ptr, types, WM_WV, n_layers * dim * kv_dim);
+    w->wo = map_matrix(&ptr, types, WM_WO, n_layers * dim * dim);
+    w->rms_ffn_weight = map_floats(&ptr, n_layers * dim);
+    w->w1 = map_matrix(&ptr, types, WM_W1, n_layers * dim * hidden_dim);
+    w->w2 = map_matrix(&ptr, types, WM_W2, n_layers * hidden_dim * dim);
+    w->w3 = map_matrix(&ptr, types, WM_W3, n_layers * dim * hidden_dim);
+    w->rms_final_weight = map_floats(&ptr, dim);
+    if (legacy) {
+        /* skip freq_cis_real and freq_cis_imag (rope.c builds its own
+           tables in SRAM rather than reading these from PSRAM) */
+        ptr += p->seq_len * head_size / 2 * sizeof(float);
+        ptr += p->seq_len * head_size / 2 * sizeof(float);
+    }
+    w->wcls = shared_weights ? w->token_embedding_table :
+              map_matrix(&ptr, types, WM_CLASSIFIER, p->vocab_size * dim);
+    return ptr;
 }
 
-int init_transformer(Transformer *t) {
-    /* Read config from the start of PSRAM (28-byte header) */
+/* ---- Load-time weight conversion ---- */
+
+static const WeightType target_types[N_WEIGHT_MATRICES] = {
+    WTYPE_EMBEDDING,
+    WTYPE_ATTENTION, WTYPE_ATTENTION, WTYPE_ATTENTION, WTYPE_ATTENTION,
+    WTYPE_FFN, WTYPE_FFN, WTYPE_FFN,
+    WTYPE_CLASSIFIER,
+};
+
+static float probe_logits[MAX_VOCAB_SIZE];
+
+static uint8_t *move_floats(uint8_t *dst, float **ptr, size_t n) {
+    dst = align4(dst);
+    memmove(dst, *ptr, n * sizeof(float));
+    *ptr = (float *)dst;
+    return dst + n * sizeof(float);
+}
+
+/*
+ * Convert an fp32 matrix to its target format at dst, or just move it if
+ * it is already converted. Grouped formats need whole groups per row;
+ * otherwise the tensor falls back to fp16.
+ */
+static uint8_t *convert_matrix(uint8_t *dst, WeightTensor *w, WeightMatrix m,
+                               size_t n, int row_len, const char *name) {
+    WeightType type = target_types[m];
+    dst = align4(dst);
+
+    if (w->type != WEIGHT_F32) {
+        size_t bytes = weight_bytes(w->type, n);
+        memmove(dst, w->data, bytes);
+        w->data = dst;
+        return dst + bytes;
+    }
+    if (!weight_row_ok(type, row_len)) {
+        printf("Weights: %s rows of %d don't fit %s groups, using f16\n",
+               name, row_len, weight_type_name(type));
+        type = WEIGHT_F16;
+    }
+
+    WeightError err = { 0 };
+    size_t bytes = weight_convert(dst, (const float *)w->data, n, type, &err);
+    w->data = dst;
+    w->type = type;
+    if (type != WEIGHT_F32) {
+        double rel = err.sum_sq_ref > 0.0 ?
+                     sqrt(err.sum_sq_err / err.sum_sq_ref) : 0.0;
+        printf("Weights: %-9s -> %-4s max_err=%.2e rel_rms=%.2e\n",
+               name, weight_type_name(type), (double)err.max_abs, rel);
+    }
+    return dst + bytes;
+}
+
+static size_t weights_size(TransformerWeights *w, Config *p,
+                           int shared_weights) {
+    size_t dim = p->dim;
+    size_t layers = p->n_layers;
+    size_t kv_dim = (dim * p->n_kv_heads) / p->n_heads;
+    size_t hidden_dim = p->hidden_dim;
+    size_t vocab = p->vocab_size;
+    size_t size = sizeof(float) * (2 * layers + 1) * dim;
+    size += weight_bytes(w->token_embedding_table.type, vocab * dim);
+    size += weight_bytes(w->wq.type, layers * dim * dim);
+    size += weight_bytes(w->wk.type, layers * dim * kv_dim);
+    size += weight_bytes(w->wv.type, layers * dim * kv_dim);
+    size += weight_bytes(w->wo.type, layers * dim * dim);
+    size += weight_bytes(w->w1.type, layers * dim * hidden_dim);
+    size += weight_bytes(w->w2.type, layers * hidden_dim * dim);
+    size += weight_bytes(w->w3.type, layers * dim * hidden_dim);
+    if (!shared_weights) size += weight_bytes(w->wcls.type, vocab * dim);
+    return size;
+}
+
+/*
+ * Rewrite fp32 weights in the WTYPE_* formats, compacting the blob front
+ * to back in file order (legacy freq_cis tables are dropped). Every
+ * tensor's destination is at or before its source, so this is safe in
+ * place. A BOS probe before and after reports the logit drift. Returns
+ * the new end of the tensor data, or NULL if nothing needed converting.
+ */
+static uint8_t *convert_weights(Transformer *t, int shared_weights) {
     Config *p = &t->config;
-    memcpy(p, (void *)PSRAM_BASE, sizeof(Config));
+    TransformerWeights *w = &t->weights;
+    WeightTensor *matrices[N_WEIGHT_MATRICES] = {
+        &w->token_embedding_table, &w->wq, &w->wk, &w->wv, &w->wo,
+        &w->w1, &w->w2, &w->w3, &w->wcls,
+    };
+    size_t dim = p->dim;
+    size_t layers = p->n_layers;
+    size_t kv_dim = (dim * p->n_kv_heads) / p->n_heads;
+    size_t hidden_dim = p->hidden_dim;
+    size_t vocab = p->vocab_size;
+
+    int needed = 0;
+    for (int m = 0; m < N_WEIGHT_MATRICES; m++) {
+        if (m == WM_CLASSIFIER && shared_weights) continue;
+        if (matrices[m]->type == WEIGHT_F32 && target_types[m] != WEIGHT_F32) {
+            needed = 1;
+        }
+    }
+    if (!needed) return NULL;
+
+    /* Conversion rewrites the blob front to back: it all has to be here */
+    if (t->loading) loader_wait(t->loading, LOADER_FINAL(p->n_layers));
+
+    size_t before = weights_size(w, p, shared_weights);
+    memcpy(probe_logits, forward(t, 1, 0), vocab * sizeof(float));
+
+    uint8_t *base = (uint8_t *)w->token_embedding_table.data;
+    uint8_t *dst = base;
+    dst = convert_matrix(dst, &w->token_embedding_table, WM_EMBEDDING,
+                         vocab * dim, dim, "embedding");
+    dst = move_floats(dst, &w->rms_att_weight, layers * dim);
+    dst = convert_matrix(dst, &w->wq, WM_WQ, layers * dim * dim, dim, "wq");
+    dst = convert_matrix(dst, &w->wk, WM_WK, layers * dim * kv_dim, dim, "wk");
+    dst = convert_matrix(dst, &w->wv, WM_WV, layers * dim * kv_dim, dim, "wv");
+    dst = convert_matrix(dst, &w->wo, WM_WO, layers * dim * dim, dim, "wo");
+    dst = move_floats(dst, &w->rms_ffn_weight, layers * dim);
+    dst = convert_matrix(dst, &w->w1, WM_W1, layers * dim * hidden_dim,
+                         dim, "w1");
+    dst = convert_matrix(dst, &w->w2, WM_W2, layers * hidden_dim * dim,
+                         hidden_dim, "w2");
+    dst = convert_matrix(dst, &w->w3, WM_W3, layers * dim * hidden_dim,
+                         dim, "w3");
+    dst = move_floats(dst, &w->rms_final_weight, dim);
+    if (shared_weights) {
+        w->wcls = w->token_embedding_table;
+    } else {
+        dst = convert_matrix(dst, &w->wcls, WM_CLASSIFIER, vocab * dim,
+                             dim, "wcls");
+    }
 
-    int shared_weights = p->vocab_size > 0 ? 1 : 0;
-    p->vocab_size = p->vocab_size < 0 ? -p->vocab_size : p->vocab_size;
+    printf("Weights: %u -> %u bytes in PSRAM\n",
+           (unsigned)before, (unsigned)weights_size(w, p, shared_weights));
+
+    float *logits = forward(t, 1, 0);
+    float max_diff = 0.0f;
+    int argmax_ref = 0, argmax_new = 0;
+    for (size_t i = 0; i < vocab; i++) {
+        float d = fabsf(logits[i] - probe_logits[i]);
+        if (d > max_diff) max_diff = d;
+        if (probe_logits[i] > probe_logits[argmax_ref]) argmax_ref = i;
+        if (logits[i] > logits[argmax_new]) argmax_new = i;
+    }
+    printf("Weights: BOS logit drift vs original: max_abs=%.2e argmax %s\n",
+           (double)max_diff, argmax_ref == argmax_new ? "same" : "CHANGED");
+    return align4(dst);
+}
+
+/*
+ * When w1 is quantised, time the FPU and fixed-point kernels on its
+ * first layer and report how far apart their outputs land.
+ */
+#define BENCH_REPS 32
+
+static void bench_kernels(Transformer *t) {
+    Config *p = &t->config;
+    RunState *s = &t->state;
+    WeightTensor *w1 = &t->weights.w1;
+    if (w1->type != WEIGHT_Q4 && w1->type != WEIGHT_Q8) return;
+
+    for (int i = 0; i < p->dim; i++) s->xb[i] = sinf(i * 0.37f);
+
+    uint64_t t0 = time_us_64();
+    for (int r = 0; r < BENCH_REPS; r++) {
+        weight_matmul_path(s->hb, s->xb, w1, 0, p->dim, p->hidden_dim, 0);
+    }
+    uint64_t t1 = time_us_64();
+    for (int r = 0; r < BENCH_REPS; r++) {
+        weight_matmul_path(s->hb2, s->xb, w1, 0, p->dim, p->hidden_dim, 1);
+    }
+    uint64_t t2 = time_us_64();
+
+    float max_diff = 0.0f, max_ref = 0.0f;
+    for (int i = 0; i < p->hidden_dim; i++) {
+        float d = fabsf(s->hb[i] - s->hb2[i]);
+        if (d > max_diff) max_diff = d;
+        if (fabsf(s->hb[i]) > max_ref) max_ref = fabsf(s->hb[i]);
+    }
+    uint32_t fpu_us = (uint32_t)((t1 - t0) / BENCH_REPS);
+    uint32_t dsp_us = (uint32_t)((t2 - t1) / BENCH_REPS);
+    printf("Kernels: w1 %s %dx%d fpu=%u us dsp=%u us (%.2fx, %s) "
+           "max_diff=%.2e of %.2e\n",
+           weight_type_name(w1->type), p->hidden_dim, p->dim,
+           (unsigned)fpu_us, (unsigned)dsp_us,
+           dsp_us ? (double)fpu_us / dsp_us : 0.0,
+           USE_DSP_KERNELS ? "dsp in use" : "fpu in use",
+           (double)max_diff, (double)max_ref);
+}
+
+/*
+ * Parse the model header at base. Fills in config, the per-matrix storage
+ * types and the start of the tensor data.
+ */
+static int read_header(uint8_t *base, Config *p, uint8_t *types,
+                       int *shared_weights, int *legacy, uint8_t **data) {
+    uint32_t magic;
+    memcpy(&magic, base, sizeof(magic));
+
+    if (magic != MODEL_MAGIC) {
+        /* Legacy llama2.c file: 28-byte / 7-int header, all fp32 */
+        memcpy(p, base, sizeof(Config));
+        *shared_weights = p->vocab_size > 0 ? 1 : 0;
+        p->vocab_size = p->vocab_size < 0 ? -p->vocab_size : p->vocab_size;
+        memset(types, WEIGHT_F32, N_WEIGHT_MATRICES);
+        *legacy = 1;
+        *data = base + sizeof(Config);
+        return 0;
+    }
+
+    ModelHeader hdr;
+    memcpy(&hdr, base, sizeof(hdr));
+    if (hdr.version != MODEL_VERSION) {
+        printf("Transformer: ERROR — unsupported model version %d\n",
+               (int)hdr.version);
+        return -1;
+    }
+    *p = hdr.config;
+    *shared_weights = hdr.shared_classifier;
+    memcpy(types, hdr.types, N_WEIGHT_MATRICES);
+    *legacy = 0;
+    *data = base + MODEL_HEADER_SIZE;
+
+    int head_size = p->dim / p->n_heads;
+    int row_lens[N_WEIGHT_MATRICES] = {
+        p->dim, p->dim, p->dim, p->dim, head_size * p->n_heads,
+        p->dim, p->hidden_dim, p->dim, p->dim,
+    };
+    for (int m = 0; m < N_WEIGHT_MATRICES; m++) {
+        if (!weight_row_ok((WeightType)types[m], row_lens[m])) {
+            printf("Transformer: ERROR — bad storage type %d for matrix %d\n",
+                   types[m], m);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int init_transformer(Transformer *t, uint8_t *blob) {
+    kernels_init();
+
+    Config *p = &t->config;
+    uint8_t types[N_WEIGHT_MATRICES];
+    int shared_weights, legacy;
+    uint8_t *weights_ptr;
+    if (read_header(blob, p, types, &shared_weights, &legacy,
+                    &weights_ptr) != 0) {
+        return -1;
+    }
+    t->blob = blob;
+    t->pins.n = 0;
+    t->kv_seq = NULL;
 
     printf("Transformer: dim=%d hidden=%d layers=%d heads=%d kv_heads=%d "
            "vocab=%d seq_len=%d\n",
@@ -70,6 +352,20 @@ int init_transformer(Transformer *t) {
         printf("Transformer: ERROR — model exceeds static buffer sizes!\n");
         return -1;
     }
+    /* Rolling past seq_len needs a ring after the sinks (kv_slot()) */
+    if (p->seq_len <= KV_SINK_TOKENS) {
+        printf("Transformer: ERROR — seq_len %d leaves no room after %d "
+               "sink tokens\n", p->seq_len, KV_SINK_TOKENS);
+        return -1;
+    }
+
+    /* Map weight pointers into PSRAM. Done before capping seq_len: the
+       skipped freq_cis tables are sized by the file's seq_len. */
+    uint8_t *end = memory_map_weights(&t->weights, p, weights_ptr, types,
+                                      shared_weights, legacy);
+
+    /* A streamed load copies the rest of the file from here on */
+    if (t->loading && loader_start(t->loading, t, end) != 0) return -1;
 
     /* Cap seq_len for KV cache sizing */
     if (p->seq_len > MAX_SEQ_LEN) {
@@ -78,9 +374,9 @@ int init_transformer(Transformer *t) {
         p->seq_len = MAX_SEQ_LEN;
     }
 
-    /* Map weight pointers into PSRAM (after 28-byte / 7-int header) */
-    float *weights_ptr = (float *)(PSRAM_BASE + sizeof(Config));
-    memory_map_weights(&t->weights, p, weights_ptr, shared_weights);
+    if (rope_init(&t->rope, p->dim / p->n_heads, p->seq_len) != 0) {
+        return -1;
+    }
 
     /* Wire RunState to static buffers */
     RunState *s = &t->state;
@@ -90,58 +386,145 @@ int init_transformer(Transformer *t) {
     s->hb = rs_hb;
     s->hb2 = rs_hb2;
     s->q = rs_q;
+    s->q_sink = rs_q_sink;
     s->att = rs_att;
     s->logits = rs_logits;
     s->key_cache = rs_key_cache;
     s->value_cache = rs_value_cache;
+    s->kv_tokens = rs_kv_tokens;
     s->k = NULL;
     s->v = NULL;
+    s->layers_run = 0;
+
+    t->early_exit.threshold = EARLY_EXIT_THRESHOLD;
+    t->early_exit.min_layer = EARLY_EXIT_MIN_LAYER ? EARLY_EXIT_MIN_LAYER :
+                              (p->n_layers + 1) / 2;
+    t->early_exit.every = EARLY_EXIT_EVERY;
+
+    uint8_t *converted_end = convert_weights(t, shared_weights);
+    if (converted_end) end = converted_end;
+    t->blob_bytes = end - blob;
+    if (t->loading == NULL) {
+        plan_placement(t);
+        bench_kernels(t);
+    }
 
     printf("Transformer: Init OK (RunState in SRAM, weights in PSRAM)\n");
     return 0;
 }
 
+void finish_transformer_load(Transformer *t) {
+    if (t->loading == NULL) return;
+    loader_wait(t->loading, LOADER_FINAL(t->config.n_layers));
+    t->loading = NULL;
+    plan_placement(t);
+    bench_kernels(t);
+}
+
 /* ---- Math helpers ---- */
 
-static void rmsnorm(float *o, float *x, float *weight, int size) {
-    float ss = 0.0f;
-    for (int j = 0; j < size; j++) {
-        ss += x[j] * x[j];
-    }
-    ss /= size;
-    ss += 1e-5f;
-    ss = 1.0f / sqrtf(ss);
-    for (int j = 0; j < size; j++) {
-        o[j] = weight[j] * (ss * x[j]);
-    }
+/* Kept for the sampler; runs on the active kernels backend */
+void softmax(float *x, int size) {
+    kernels->softmax(x, size);
 }
 
-void softmax(float *x, int size) {
-    float max_val = x[0];
-    for (int i = 1; i < size; i++) {
-        if (x[i] > max_val) max_val = x[i];
+/* ---- Forward pass ---- */
+
+static int kv_slot(Config *p, int pos) {
+    if (pos < p->seq_len) return pos;
+    int window = p->seq_len - KV_SINK_TOKENS;
+    return KV_SINK_TOKENS + (pos - KV_SINK_TOKENS) % window;
+}
+
+/*
+ * Attention for head h over a paged sequence: scores and mix one block of
+ * positions at a time, each block's rows being contiguous in its page.
+ */
+static void attend_paged(Transformer *t, KVSeq *seq, int l, int h,
+                         int n_ctx) {
+    Config *p = &t->config;
+    RunState *s = &t->state;
+    int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    int head_size = p->dim / p->n_heads;
+    int hoff = (h / (p->n_heads / p->n_kv_heads)) * head_size;
+    float *q = s->q + h * head_size;
+    float *att = s->att + h * p->seq_len;
+    float *out = s->xb + h * head_size;
+    float mix[MAX_HEAD_SIZE];
+
+    for (int start = 0; start < n_ctx; start += KV_BLOCK_SIZE) {
+        int n = n_ctx - start < KV_BLOCK_SIZE ? n_ctx - start : KV_BLOCK_SIZE;
+        kernels->attn_scores(att + start, q,
+                             kv_seq_key(seq, l, start) + hoff, kv_dim, n,
+                             head_size);
     }
-    float sum = 0.0f;
-    for (int i = 0; i < size; i++) {
-        x[i] = expf(x[i] - max_val);
-        sum += x[i];
+    kernels->softmax(att, n_ctx);
+    for (int start = 0; start < n_ctx; start += KV_BLOCK_SIZE) {
+        int n = n_ctx - start < KV_BLOCK_SIZE ? n_ctx - start : KV_BLOCK_SIZE;
+        kernels->attn_mix(start ? mix : out, att + start,
+                          kv_seq_value(seq, l, start) + hoff, kv_dim, n,
+                          head_size);
+        if (start) {
+            for (int i = 0; i < head_size; i++) out[i] += mix[i];
+        }
     }
-    for (int i = 0; i < size; i++) {
-        x[i] /= sum;
+}
+
+/* Wait for the streaming loader to make stage resident (loader.h) */
+static void await_stage(Transformer *t, int stage) {
+    if (t->loading) loader_wait(t->loading, stage);
+}
+
+/* Point s->k / s->v at layer l's cache row for pos */
+static void kv_row(Transformer *t, KVSeq *seq, int l, int pos, int slot) {
+    Config *p = &t->config;
+    RunState *s = &t->state;
+    int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    if (seq) {
+        s->k = kv_seq_key(seq, l, pos);
+        s->v = kv_seq_value(seq, l, pos);
+    } else {
+        int loff = l * p->seq_len * kv_dim;
+        s->k = s->key_cache + loff + slot * kv_dim;
+        s->v = s->value_cache + loff + slot * kv_dim;
     }
 }
 
-static void matmul(float *xout, float *x, float *w, int n, int d) {
-    for (int i = 0; i < d; i++) {
-        float val = 0.0f;
-        for (int j = 0; j < n; j++) {
-            val += w[i * n + j] * x[j];
-        }
-        xout[i] = val;
+/* Final rmsnorm + classifier on the residual x into s->logits; nonzero if
+   the top token's probability reaches the exit threshold */
+static int exit_confident(Transformer *t, const float *x) {
+    Config *p = &t->config;
+    RunState *s = &t->state;
+    kernels->rmsnorm(s->xb, x, t->weights.rms_final_weight, p->dim);
+    weight_matmul(s->logits, s->xb, &t->weights.wcls, 0, p->dim,
+                  p->vocab_size);
+    float max = s->logits[0];
+    for (int i = 1; i < p->vocab_size; i++) {
+        if (s->logits[i] > max) max = s->logits[i];
     }
+    float sum = 0.0f;
+    for (int i = 0; i < p->vocab_size; i++) sum += expf(s->logits[i] - max);
+    return 1.0f / sum >= t->early_exit.threshold;
 }
 
-/* ---- Forward pass ---- */
+/* Keys and values of layers from..n_layers-1 projected from x */
+static void backfill_kv(Transformer *t, KVSeq *seq, int from, int pos,
+                        int slot, const float *x, const float *rope_cos,
+                        const float *rope_sin) {
+    Config *p = &t->config;
+    TransformerWeights *w = &t->weights;
+    RunState *s = &t->state;
+    int dim = p->dim;
+    int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    for (int l = from; l < p->n_layers; l++) {
+        await_stage(t, LOADER_LAYER(l));
+        kv_row(t, seq, l, pos, slot);
+        kernels->rmsnorm(s->xb, x, w->rms_att_weight + l * dim, dim);
+        weight_matmul(s->k, s->xb, &w->wk, (size_t)l * dim * kv_dim, dim, kv_dim);
+        weight_matmul(s->v, s->xb, &w->wv, (size_t)l * dim * kv_dim, dim, kv_dim);
+        rope_rotate(s->k, kv_dim, dim / p->n_heads, rope_cos, rope_sin);
+    }
+}
 
 float *forward(Transformer *transformer, int token, int pos) {
     Config *p = &transformer->config;
@@ -154,106 +537,228 @@ float *forward(Transformer *transformer, int token, int pos) {
     int hidden_dim = p->hidden_dim;
     int head_size = dim / p->n_heads;
 
+    /* Paged sequences get their block for pos made writable first */
+    KVSeq *seq = transformer->kv_seq;
+    if (seq && kv_seq_prepare(seq, pos) != 0) return NULL;
+
+    /* Past seq_len the cache is a ring after the first KV_SINK_TOKENS */
+    int rolling = pos >= p->seq_len;
+    int slot = kv_slot(p, pos);
+    int n_ctx = rolling ? p->seq_len : pos + 1;
+    if (!seq) s->kv_tokens[slot] = token;
+
+    /* One RoPE row per token, shared by every layer */
+    const float *rope_cos, *rope_sin, *sink_cos = NULL, *sink_sin = NULL;
+    rope_row(&transformer->rope, pos, &rope_cos, &rope_sin);
+    if (rolling) {
+        rope_row(&transformer->rope, p->seq_len - 1, &sink_cos, &sink_sin);
+    }
+
     /* Copy token embedding into x */
-    float *content_row = w->token_embedding_table + token * dim;
-    memcpy(x, content_row, dim * sizeof(float));
+    await_stage(transformer, 0);
+    weight_row(x, &w->token_embedding_table, (size_t)token * dim, dim);
 
     /* For each layer */
     for (int l = 0; l < p->n_layers; l++) {
+        await_stage(transformer, LOADER_LAYER(l));
 
         /* Attention rmsnorm */
-        rmsnorm(s->xb, x, w->rms_att_weight + l * dim, dim);
+        kernels->rmsnorm(s->xb, x, w->rms_att_weight + l * dim, dim);
 
         /* KV cache pointers for this layer+position */
         int loff = l * p->seq_len * kv_dim;
-        s->k = s->key_cache + loff + pos * kv_dim;
-        s->v = s->value_cache + loff + pos * kv_dim;
+        kv_row(transformer, seq, l, pos, slot);
 
         /* QKV matmuls */
-        matmul(s->q, s->xb, w->wq + l * dim * dim, dim, dim);
-        matmul(s->k, s->xb, w->wk + l * dim * kv_dim, dim, kv_dim);
-        matmul(s->v, s->xb, w->wv + l * dim * kv_dim, dim, kv_dim);
+        weight_matmul(s->q, s->xb, &w->wq, (size_t)l * dim * dim, dim, dim);
+        weight_matmul(s->k, s->xb, &w->wk, (size_t)l * dim * kv_dim, dim, kv_dim);
+        weight_matmul(s->v, s->xb, &w->wv, (size_t)l * dim * kv_dim, dim, kv_dim);
+        if (rolling) memcpy(s->q_sink, s->q, dim * sizeof(float));
 
         /* RoPE rotation */
-        for (int i = 0; i < dim; i += 2) {
-            int head_dim = i % head_size;
-            float freq = 1.0f / powf(10000.0f, head_dim / (float)head_size);
-            float val = pos * freq;
-            float fcr = cosf(val);
-            float fci = sinf(val);
-            int rotn = i < kv_dim ? 2 : 1;
-            for (int v = 0; v < rotn; v++) {
-                float *vec = v == 0 ? s->q : s->k;
-                float v0 = vec[i];
-                float v1 = vec[i + 1];
-                vec[i]     = v0 * fcr - v1 * fci;
-                vec[i + 1] = v0 * fci + v1 * fcr;
-            }
+        rope_rotate(s->q, dim, head_size, rope_cos, rope_sin);
+        rope_rotate(s->k, kv_dim, head_size, rope_cos, rope_sin);
+
+        /* Once the cache rolls, sinks are scored as if the query sat at
+           the end of the cache rather than at its true position. Window
+           keys keep their true positions: the window is contiguous, so
+           their distances to the query are the same either way. */
+        if (rolling) {
+            rope_rotate(s->q_sink, dim, head_size, sink_cos, sink_sin);
         }
 
-        /* Multi-head attention */
+        /* Multi-head attention over the n_ctx occupied cache slots */
+        int n_sink = rolling ? KV_SINK_TOKENS : 0;
         for (int h = 0; h < p->n_heads; h++) {
+            if (seq) {
+                attend_paged(transformer, seq, l, h, n_ctx);
+                continue;
+            }
             float *q = s->q + h * head_size;
             float *att = s->att + h * p->seq_len;
+            int hoff = loff + (h / kv_mul) * head_size;
 
-            for (int t = 0; t <= pos; t++) {
-                float *k = s->key_cache + loff + t * kv_dim +
-                           (h / kv_mul) * head_size;
-                float score = 0.0f;
-                for (int i = 0; i < head_size; i++) {
-                    score += q[i] * k[i];
-                }
-                score /= sqrtf(head_size);
-                att[t] = score;
+            if (n_sink) {
+                kernels->attn_scores(att, s->q_sink + h * head_size,
+                                     s->key_cache + hoff, kv_dim,
+                                     n_sink, head_size);
             }
+            kernels->attn_scores(att + n_sink, q,
+                                 s->key_cache + hoff + n_sink * kv_dim,
+                                 kv_dim, n_ctx - n_sink, head_size);
 
-            softmax(att, pos + 1);
-
-            float *xb = s->xb + h * head_size;
-            memset(xb, 0, head_size * sizeof(float));
-            for (int t = 0; t <= pos; t++) {
-                float *v = s->value_cache + loff + t * kv_dim +
-                           (h / kv_mul) * head_size;
-                float a = att[t];
-                for (int i = 0; i < head_size; i++) {
-                    xb[i] += a * v[i];
-                }
-            }
+            kernels->softmax(att, n_ctx);
+
+            kernels->attn_mix(s->xb + h * head_size, att,
+                              s->value_cache + hoff, kv_dim, n_ctx,
+                              head_size);
         }
 
         /* Output projection + residual */
-        matmul(s->xb2, s->xb, w->wo + l * dim * dim, dim, dim);
+        weight_matmul(s->xb2, s->xb, &w->wo, (size_t)l * dim * dim, dim, dim);
         for (int i = 0; i < dim; i++) {
             x[i] += s->xb2[i];
         }
 
         /* FFN rmsnorm */
-        rmsnorm(s->xb, x, w->rms_ffn_weight + l * dim, dim);
+        kernels->rmsnorm(s->xb, x, w->rms_ffn_weight + l * dim, dim);
 
         /* FFN: w1, w3, SiLU, w2 */
-        matmul(s->hb, s->xb, w->w1 + l * dim * hidden_dim, dim, hidden_dim);
-        matmul(s->hb2, s->xb, w->w3 + l * dim * hidden_dim, dim, hidden_dim);
+        weight_matmul(s->hb, s->xb, &w->w1, (size_t)l * dim * hidden_dim,
+                      dim, hidden_dim);
+        weight_matmul(s->hb2, s->xb, &w->w3, (size_t)l * dim * hidden_dim,
+                      dim, hidden_dim);
 
         /* SiLU activation and element-wise multiply */
-        for (int i = 0; i < hidden_dim; i++) {
-            float v = s->hb[i];
-            v *= (1.0f / (1.0f + expf(-v)));
-            v *= s->hb2[i];
-            s->hb[i] = v;
-        }
+        kernels->swiglu(s->hb, s->hb2, hidden_dim);
 
-        matmul(s->xb, s->hb, w->w2 + l * dim * hidden_dim, hidden_dim, dim);
+        weight_matmul(s->xb, s->hb, &w->w2, (size_t)l * dim * hidden_dim,
+                      hidden_dim, dim);
 
         /* Residual */
         for (int i = 0; i < dim; i++) {
             x[i] += s->xb[i];
         }
+
+        /* Early exit: stop here if the classifier is already confident */
+        const EarlyExit *ee = &transformer->early_exit;
+        int ran = l + 1;
+        if (ee->threshold > 0.0f && ran < p->n_layers &&
+            ran >= ee->min_layer &&
+            (ee->every <= 1 || (ran - ee->min_layer) % ee->every == 0) &&
+            exit_confident(transformer, x)) {
+            backfill_kv(transformer, seq, ran, pos, slot, x, rope_cos,
+                        rope_sin);
+            s->layers_run = ran;
+            return s->logits;
+        }
     }
+    s->layers_run = p->n_layers;
 
     /* Final rmsnorm */
-    rmsnorm(x, x, w->rms_final_weight, dim);
+    kernels->rmsnorm(x, x, w->rms_final_weight, dim);
 
     /* Classifier */
-    matmul(s->logits, x, w->wcls, p->dim, p->vocab_size);
+    weight_matmul(s->logits, x, &w->wcls, 0, p->dim, p->vocab_size);
     return s->logits;
 }
+
+float *forward_batch(Transformer *transformer, const int *tokens, int n,
+                     int pos) {
+    Config *p = &transformer->config;
+    TransformerWeights *w = &transformer->weights;
+    RunState *s = &transformer->state;
+    int dim = p->dim;
+    int kv_dim = (p->dim * p->n_kv_heads) / p->n_heads;
+    int kv_mul = p->n_heads / p->n_kv_heads;
+    int hidden_dim = p->hidden_dim;
+    int head_size = dim / p->n_heads;
+
+    if (n < 1 || n > MAX_BATCH || pos < 0 || pos + n > p->seq_len ||
+        transformer->kv_seq) {
+        return NULL;
+    }
+
+    await_stage(transformer, 0);
+    for (int b = 0; b < n; b++) {
+        weight_row(bs_x + b * dim, &w->token_embedding_table,
+                   (size_t)tokens[b] * dim, dim);
+        s->kv_tokens[pos + b] = tokens[b];
+    }
+
+    for (int l = 0; l < p->n_layers; l++) {
+        await_stage(transformer, LOADER_LAYER(l));
+        int loff = l * p->seq_len * kv_dim;
+        float *k = s->key_cache + loff + pos * kv_dim;
+        float *v = s->value_cache + loff + pos * kv_dim;
+
+        for (int b = 0; b < n; b++) {
+            kernels->rmsnorm(bs_xb + b * dim, bs_x + b * dim,
+                             w->rms_att_weight + l * dim, dim);
+        }
+
+        /* QKV for the whole batch; the positions' cache rows are
+           contiguous, so K and V land in the cache directly */
+        weight_matmul_batch(bs_q, bs_xb, &w->wq, (size_t)l * dim * dim,
+                            dim, dim, n, bs_row);
+        weight_matmul_batch(k, bs_xb, &w->wk, (size_t)l * dim * kv_dim,
+                            dim, kv_dim, n, bs_row);
+        weight_matmul_batch(v, bs_xb, &w->wv, (size_t)l * dim * kv_dim,
+                            dim, kv_dim, n, bs_row);
+
+        for (int b = 0; b < n; b++) {
+            const float *rope_cos, *rope_sin;
+            rope_row(&transformer->rope, pos + b, &rope_cos, &rope_sin);
+            rope_rotate(bs_q + b * dim, dim, head_size, rope_cos, rope_sin);
+            rope_rotate(k + b * kv_dim, kv_dim, head_size, rope_cos,
+                        rope_sin);
+        }
+
+        /* Causal attention: every batch position's K/V is in the cache
+           by now, and position pos+b looks at the pos+b+1 before it */
+        for (int b = 0; b < n; b++) {
+            int n_ctx = pos + b + 1;
+            for (int h = 0; h < p->n_heads; h++) {
+                float *att = s->att + h * p->seq_len;
+                int hoff = loff + (h / kv_mul) * head_size;
+                kernels->attn_scores(att, bs_q + b * dim + h * head_size,
+                                     s->key_cache + hoff, kv_dim, n_ctx,
+                                     head_size);
+                kernels->softmax(att, n_ctx);
+                kernels->attn_mix(bs_xb + b * dim + h * head_size, att,
+                                  s->value_cache + hoff, kv_dim, n_ctx,
+                                  head_size);
+            }
+        }
+
+        weight_matmul_batch(bs_xb2, bs_xb, &w->wo, (size_t)l * dim * dim,
+                            dim, dim, n, bs_row);
+        for (int i = 0; i < n * dim; i++) {
+            bs_x[i] += bs_xb2[i];
+        }
+
+        for (int b = 0; b < n; b++) {
+            kernels->rmsnorm(bs_xb + b * dim, bs_x + b * dim,
+                             w->rms_ffn_weight + l * dim, dim);
+        }
+        weight_matmul_batch(bs_hb, bs_xb, &w->w1,
+                            (size_t)l * dim * hidden_dim, dim, hidden_dim, n,
+                            bs_row);
+        weight_matmul_batch(bs_hb2, bs_xb, &w->w3,
+                            (size_t)l * dim * hidden_dim, dim, hidden_dim, n,
+                            bs_row);
+        kernels->swiglu(bs_hb, bs_hb2, n * hidden_dim);
+        weight_matmul_batch(bs_xb, bs_hb, &w->w2,
+                            (size_t)l * dim * hidden_dim, hidden_dim, dim, n,
+                            bs_row);
+        for (int i = 0; i < n * dim; i++) {
+            bs_x[i] += bs_xb[i];
+        }
+    }
+
+    for (int b = 0; b < n; b++) {
+        kernels->rmsnorm(bs_x + b * dim, bs_x + b * dim, w->rms_final_weight,
+                         dim);
+    }
+    return bs_x;
+}
@@ -2,19 +2,40 @@
 #define TRANSFORMER_H
 
 #include <stdint.h>
+#include "model_limits.h"
+#include "weights.h"
+#include "rope.h"
 
-/* Cap sequence length to fit RunState in 520 KB SRAM */
-#define MAX_SEQ_LEN 256
+/*
+ * Rolling KV cache: once pos reaches seq_len, the first KV_SINK_TOKENS
+ * positions stay in the cache as attention sinks and the remaining slots
+ * become a ring over the most recent positions. init_transformer()
+ * rejects models with seq_len <= KV_SINK_TOKENS, which leave no ring.
+ */
+#define KV_SINK_TOKENS 4
+#if MAX_SEQ_LEN <= KV_SINK_TOKENS
+#error "MAX_SEQ_LEN must leave room for a ring after KV_SINK_TOKENS"
+#endif
 
-/* stories260K model dimensions — used for static buffer sizing */
-#define MAX_DIM        64
-#define MAX_HIDDEN_DIM 172
-#define MAX_N_LAYERS   5
-#define MAX_N_HEADS    8
-#define MAX_N_KV_HEADS 4
-#define MAX_VOCAB_SIZE 512
-#define MAX_KV_DIM     ((MAX_DIM * MAX_N_KV_HEADS) / MAX_N_HEADS)  /* 32 */
-#define MAX_HEAD_SIZE  (MAX_DIM / MAX_N_HEADS)                      /* 8 */
+/*
+ * Storage format of each weight matrix after init_transformer(). Anything
+ * other than WEIGHT_F32 is converted from fp32 in place at load time,
+ * shrinking that tensor's PSRAM footprint and bandwidth. rmsnorm weights
+ * always stay fp32. A shared classifier follows the embedding. Tensors
+ * already stored in another format (PLMA files) are left as they are.
+ */
+#ifndef WTYPE_EMBEDDING
+#define WTYPE_EMBEDDING  WEIGHT_F32
+#endif
+#ifndef WTYPE_ATTENTION
+#define WTYPE_ATTENTION  WEIGHT_F32   /* wq, wk, wv, wo */
+#endif
+#ifndef WTYPE_FFN
+#define WTYPE_FFN        WEIGHT_F32   /* w1, w2, w3 */
+#endif
+#ifndef WTYPE_CLASSIFIER
+#define WTYPE_CLASSIFIER WEIGHT_F32
+#endif
 
 typedef struct {
     int dim;
@@ -26,19 +47,52 @@ typedef struct {
     int seq_len;
 } Config;
 
+/* Weight matrices in file order; indexes ModelHeader.types */
+typedef enum {
+    WM_EMBEDDING = 0,
+    WM_WQ,
+    WM_WK,
+    WM_WV,
+    WM_WO,
+    WM_W1,
+    WM_W2,
+    WM_W3,
+    WM_CLASSIFIER,
+    N_WEIGHT_MATRICES
+} WeightMatrix;
+
+/*
+ * Pre-converted model file, written by tools/quantize.c. Legacy llama2.c
+ * files start directly with Config instead. After the header come the
+ * tensors in llama2.c order without the freq_cis tables, each starting on
+ * a 4-byte boundary: embedding, rms_att, wq, wk, wv, wo, rms_ffn, w1, w2,
+ * w3, rms_final, then wcls unless shared. rmsnorm weights are fp32.
+ */
+#define MODEL_MAGIC       0x414d4c50   /* "PLMA" */
+#define MODEL_VERSION     1
+#define MODEL_HEADER_SIZE 256
+
 typedef struct {
-    float *token_embedding_table;
+    uint32_t magic;
+    int32_t version;
+    Config config;                      /* vocab_size always positive */
+    uint8_t shared_classifier;
+    uint8_t types[N_WEIGHT_MATRICES];   /* WeightType per WeightMatrix */
+} ModelHeader;
+
+typedef struct {
+    WeightTensor token_embedding_table;
     float *rms_att_weight;
     float *rms_ffn_weight;
-    float *wq;
-    float *wk;
-    float *wv;
-    float *wo;
-    float *w1;
-    float *w2;
-    float *w3;
+    WeightTensor wq;
+    WeightTensor wk;
+    WeightTensor wv;
+    WeightTensor wo;
+    WeightTensor w1;
+    WeightTensor w2;
+    WeightTensor w3;
     float *rms_final_weight;
-    float *wcls;
+    WeightTensor wcls;
 } TransformerWeights;
 
 typedef struct {
@@ -48,29 +102,113 @@ typedef struct {
     float *hb;
     float *hb2;
     float *q;
+    float *q_sink;  /* query rotated for the sinks once the cache rolls */
     float *k;       /* points into key_cache */
     float *v;       /* points into value_cache */
     float *att;
     float *logits;
     float *key_cache;
     float *value_cache;
+    int *kv_tokens;     /* token held in each KV slot (session.h) */
+    int layers_run;     /* layers the last forward() ran in full */
 } RunState;
 
+/*
+ * Tensors plan_placement() copied into the SRAM pool, in pool order, with
+ * the PSRAM copies they came from. Lets a model hand the pool to another
+ * resident model and take it back later without planning again.
+ */
+#define MAX_PINNED 12
+
+typedef struct {
+    int n;
+    uint8_t tensor[MAX_PINNED];   /* placement candidate index */
+    void *home[MAX_PINNED];       /* PSRAM copy */
+} PinPlan;
+
+/*
+ * Early exit (adaptive depth). After layer min_layer and every `every`
+ * layers from there, forward() applies the final rmsnorm and the shared
+ * classifier to the residual stream; if the top softmax probability is at
+ * least threshold it returns those logits without running the remaining
+ * layers. The skipped layers still get this position's keys and values,
+ * projected from the exit residual (KV backfill: their K/V matmuls only),
+ * so later tokens attend over a full cache. Each check costs one
+ * classifier pass. threshold 0 turns it off; tools/exitcheck.c measures
+ * layers per token, speedup and drift against full depth.
+ */
+#ifndef EARLY_EXIT_THRESHOLD
+#define EARLY_EXIT_THRESHOLD 0.0f
+#endif
+#ifndef EARLY_EXIT_MIN_LAYER
+#define EARLY_EXIT_MIN_LAYER 0      /* 0 = (n_layers + 1) / 2 */
+#endif
+#ifndef EARLY_EXIT_EVERY
+#define EARLY_EXIT_EVERY 1          /* layers between checks */
+#endif
+
+typedef struct {
+    float threshold;
+    int min_layer;      /* layers run before the first check (>= 1) */
+    int every;          /* layers between checks (<= 1: after each) */
+} EarlyExit;
+
+struct KVSeq;
+struct ModelStream;
+
 typedef struct {
     Config config;
     TransformerWeights weights;
     RunState state;
+    RopeTable rope;
+    PinPlan pins;
+    struct KVSeq *kv_seq;   /* paged KV sequence to run on (kvpage.h), or
+                               NULL for the contiguous cache */
+    EarlyExit early_exit;
+    struct ModelStream *loading;  /* streaming loader still filling blob
+                                     (loader.h), or NULL */
+    uint8_t *blob;          /* model file in PSRAM */
+    size_t blob_bytes;      /* bytes of it still in use after conversion */
 } Transformer;
 
 /**
- * Initialise the transformer: parse config from PSRAM, map weight pointers,
- * set up RunState to use static SRAM buffers. Returns 0 on success.
+ * Initialise the transformer from the model file at blob in PSRAM: parse
+ * the config (legacy or PLMA header), map weight pointers, set up RunState
+ * to use static SRAM buffers, and convert any fp32 tensors selected by
+ * WTYPE_*. RunState, the RoPE tables and the SRAM pin pool are shared by
+ * every Transformer; see models.h for switching between several.
+ * With t->loading set, only the header need be in place: the loader
+ * starts copying the rest, WTYPE_* conversion waits for all of it, and
+ * SRAM placement is left to finish_transformer_load(). Returns 0 on
+ * success.
  */
-int init_transformer(Transformer *t);
+int init_transformer(Transformer *t, uint8_t *blob);
+
+/**
+ * Wait for a streamed load (t->loading) to complete, then plan the SRAM
+ * placement init_transformer() deferred. Until then only forward(),
+ * forward_batch() and their callers may read the weights. t must be the
+ * active model. No-op if t wasn't streamed.
+ */
+void finish_transformer_load(Transformer *t);
 
 /**
  * Run one forward pass. Returns pointer to logits (vocab_size floats).
+ * pos may run past seq_len; the KV cache then rolls (see KV_SINK_TOKENS)
+ * so memory and per-token cost stay constant. With t->kv_seq set, runs on
+ * that paged sequence instead and returns NULL if it can't get a page.
  */
 float *forward(Transformer *t, int token, int pos);
 
+/**
+ * Run tokens[0..n) at positions pos..pos+n-1 together, n <= MAX_BATCH,
+ * filling their contiguous KV cache slots. Each weight row is streamed
+ * from PSRAM once per batch rather than once per position. Positions must
+ * stay below seq_len (no rolling) and t->kv_seq must be NULL. Returns the
+ * final rmsnormed hidden states, n rows of dim, for the caller to classify
+ * (the classifier is left out so vocab-sized logits need not exist for
+ * every position at once); NULL if the batch doesn't fit.
+ */
+float *forward_batch(Transformer *t, const int *tokens, int n, int pos);
+
 #endif /* TRANSFORMER_H */
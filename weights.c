@@ -0,0 +1,429 @@
+#include "weights.h"
+#include "model_limits.h"
+#include "half.h"
+#include "dsp.h"
+#include "kernels.h"
+#include <math.h>
+#include <string.h>
+
+#define MAX_MATMUL_N (MAX_HIDDEN_DIM > MAX_DIM ? MAX_HIDDEN_DIM : MAX_DIM)
+
+const char *weight_type_name(WeightType type) {
+    switch (type) {
+    case WEIGHT_F32:  return "f32";
+    case WEIGHT_F16:  return "f16";
+    case WEIGHT_BF16: return "bf16";
+    case WEIGHT_Q4:   return "q4";
+    case WEIGHT_Q8:   return "q8";
+    case WEIGHT_S8:   return "s8";
+    default:          break;
+    }
+    return "?";
+}
+
+size_t weight_bytes(WeightType type, size_t n) {
+    switch (type) {
+    case WEIGHT_F16:
+    case WEIGHT_BF16:
+        return n * sizeof(uint16_t);
+    case WEIGHT_Q4:
+        return (n / Q4_GROUP_SIZE) * sizeof(BlockQ4);
+    case WEIGHT_Q8:
+        return (n / Q8_GROUP_SIZE) * sizeof(BlockQ8);
+    case WEIGHT_S8:
+        return (n / S8_GROUP_SIZE) * sizeof(BlockS8);
+    case WEIGHT_F32:
+    default:
+        return n * sizeof(float);
+    }
+}
+
+int weight_row_ok(WeightType type, int row_len) {
+    if (type == WEIGHT_Q4) return row_len % Q4_GROUP_SIZE == 0;
+    if (type == WEIGHT_Q8) return row_len % Q8_GROUP_SIZE == 0;
+    if (type == WEIGHT_S8) return row_len % S8_GROUP_SIZE == 0;
+    return type < N_WEIGHT_TYPES;
+}
+
+/* ---- Load-time conversion ---- */
+
+static void accumulate_error(WeightError *err, float ref, float got) {
+    float e = fabsf(ref - got);
+    if (e > err->max_abs) err->max_abs = e;
+    err->sum_sq_err += (double)e * e;
+    err->sum_sq_ref += (double)ref * ref;
+}
+
+/*
+ * Quantise one group. The scale is rounded to fp16 before use so the
+ * error reported matches what the kernels will see.
+ */
+static void quantize_q4_group(BlockQ4 *b, const float *x, WeightError *err) {
+    float amax = 0.0f;
+    for (int i = 0; i < Q4_GROUP_SIZE; i++) {
+        float a = fabsf(x[i]);
+        if (a > amax) amax = a;
+    }
+    uint16_t scale_h = f32_to_f16(amax / 7.0f);
+    float scale = f16_to_f32(scale_h);
+    float inv = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+    uint8_t qs[Q4_GROUP_SIZE / 2];
+    for (int i = 0; i < Q4_GROUP_SIZE; i += 2) {
+        int q0 = (int)roundf(x[i] * inv);
+        int q1 = (int)roundf(x[i + 1] * inv);
+        q0 = q0 < -8 ? -8 : (q0 > 7 ? 7 : q0);
+        q1 = q1 < -8 ? -8 : (q1 > 7 ? 7 : q1);
+        qs[i / 2] = (uint8_t)((q0 + 8) | ((q1 + 8) << 4));
+        if (err) {
+            accumulate_error(err, x[i], q0 * scale);
+            accumulate_error(err, x[i + 1], q1 * scale);
+        }
+    }
+    b->scale = scale_h;
+    memcpy(b->qs, qs, sizeof(qs));
+}
+
+static void quantize_q8_group(BlockQ8 *b, const float *x, WeightError *err) {
+    float amax = 0.0f;
+    for (int i = 0; i < Q8_GROUP_SIZE; i++) {
+        float a = fabsf(x[i]);
+        if (a > amax) amax = a;
+    }
+    uint16_t scale_h = f32_to_f16(amax / 127.0f);
+    float scale = f16_to_f32(scale_h);
+    float inv = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+    int8_t qs[Q8_GROUP_SIZE];
+    for (int i = 0; i < Q8_GROUP_SIZE; i++) {
+        int q = (int)roundf(x[i] * inv);
+        q = q < -127 ? -127 : (q > 127 ? 127 : q);
+        qs[i] = (int8_t)q;
+        if (err) accumulate_error(err, x[i], q * scale);
+    }
+    b->scale = scale_h;
+    memcpy(b->qs, qs, sizeof(qs));
+}
+
+/*
+ * Prune each run of 4 to its 2 largest magnitudes (kept in element order),
+ * then quantise those like Q8. Pruned elements count as error.
+ */
+static void quantize_s8_group(BlockS8 *b, const float *x, WeightError *err) {
+    float kept[S8_GROUP_SIZE / 2];
+    uint8_t idx[S8_GROUP_SIZE / 8] = { 0 };
+    for (int r = 0; r < S8_GROUP_SIZE / 4; r++) {
+        const float *run = x + 4 * r;
+        int a = 0, c = 1;
+        if (fabsf(run[c]) > fabsf(run[a])) { a = 1; c = 0; }
+        for (int k = 2; k < 4; k++) {
+            if (fabsf(run[k]) > fabsf(run[a])) {
+                c = a;
+                a = k;
+            } else if (fabsf(run[k]) > fabsf(run[c])) {
+                c = k;
+            }
+        }
+        int lo = a < c ? a : c, hi = a < c ? c : a;
+        kept[2 * r] = run[lo];
+        kept[2 * r + 1] = run[hi];
+        idx[r / 2] |= (uint8_t)((lo | (hi << 2)) << (4 * (r % 2)));
+        if (err) {
+            for (int k = 0; k < 4; k++) {
+                if (k != lo && k != hi) accumulate_error(err, run[k], 0.0f);
+            }
+        }
+    }
+
+    float amax = 0.0f;
+    for (int j = 0; j < S8_GROUP_SIZE / 2; j++) {
+        float v = fabsf(kept[j]);
+        if (v > amax) amax = v;
+    }
+    uint16_t scale_h = f32_to_f16(amax / 127.0f);
+    float scale = f16_to_f32(scale_h);
+    float inv = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+    int8_t qs[S8_GROUP_SIZE / 2];
+    for (int j = 0; j < S8_GROUP_SIZE / 2; j++) {
+        int q = (int)roundf(kept[j] * inv);
+        q = q < -127 ? -127 : (q > 127 ? 127 : q);
+        qs[j] = (int8_t)q;
+        if (err) accumulate_error(err, kept[j], q * scale);
+    }
+    b->scale = scale_h;
+    memcpy(b->idx, idx, sizeof(idx));
+    memcpy(b->qs, qs, sizeof(qs));
+}
+
+size_t weight_convert(void *dst, const float *src, size_t n, WeightType type,
+                      WeightError *err) {
+    uint16_t *h = (uint16_t *)dst;
+
+    switch (type) {
+    case WEIGHT_F16:
+        /* Read before write: h[i] never overlaps an unread src[j > i] */
+        for (size_t i = 0; i < n; i++) {
+            float v = src[i];
+            h[i] = f32_to_f16(v);
+            if (err) accumulate_error(err, v, f16_to_f32(h[i]));
+        }
+        break;
+    case WEIGHT_BF16:
+        for (size_t i = 0; i < n; i++) {
+            float v = src[i];
+            h[i] = f32_to_bf16(v);
+            if (err) accumulate_error(err, v, bf16_to_f32(h[i]));
+        }
+        break;
+    case WEIGHT_Q4: {
+        /* Each group is copied out before its (smaller) block is written */
+        BlockQ4 *blocks = (BlockQ4 *)dst;
+        float group[Q4_GROUP_SIZE];
+        for (size_t g = 0; g < n / Q4_GROUP_SIZE; g++) {
+            memcpy(group, src + g * Q4_GROUP_SIZE, sizeof(group));
+            quantize_q4_group(&blocks[g], group, err);
+        }
+        break;
+    }
+    case WEIGHT_Q8: {
+        BlockQ8 *blocks = (BlockQ8 *)dst;
+        float group[Q8_GROUP_SIZE];
+        for (size_t g = 0; g < n / Q8_GROUP_SIZE; g++) {
+            memcpy(group, src + g * Q8_GROUP_SIZE, sizeof(group));
+            quantize_q8_group(&blocks[g], group, err);
+        }
+        break;
+    }
+    case WEIGHT_S8: {
+        BlockS8 *blocks = (BlockS8 *)dst;
+        float group[S8_GROUP_SIZE];
+        for (size_t g = 0; g < n / S8_GROUP_SIZE; g++) {
+            memcpy(group, src + g * S8_GROUP_SIZE, sizeof(group));
+            quantize_s8_group(&blocks[g], group, err);
+        }
+        break;
+    }
+    case WEIGHT_F32:
+    default:
+        if (dst != (void *)src) memmove(dst, src, n * sizeof(float));
+        break;
+    }
+    return weight_bytes(type, n);
+}
+
+/* ---- Kernels ---- */
+
+void weight_row(float *out, const WeightTensor *w, size_t offset, int n) {
+    switch (w->type) {
+    case WEIGHT_F16: {
+        const uint16_t *h = (const uint16_t *)w->data + offset;
+        for (int i = 0; i < n; i++) out[i] = f16_to_f32(h[i]);
+        break;
+    }
+    case WEIGHT_BF16: {
+        const uint16_t *h = (const uint16_t *)w->data + offset;
+        for (int i = 0; i < n; i++) out[i] = bf16_to_f32(h[i]);
+        break;
+    }
+    case WEIGHT_Q4: {
+        const BlockQ4 *b = (const BlockQ4 *)w->data + offset / Q4_GROUP_SIZE;
+        for (int g = 0; g < n / Q4_GROUP_SIZE; g++, b++) {
+            float scale = f16_to_f32(b->scale);
+            for (int k = 0; k < Q4_GROUP_SIZE / 2; k++) {
+                out[2 * k]     = ((b->qs[k] & 0x0f) - 8) * scale;
+                out[2 * k + 1] = ((b->qs[k] >> 4) - 8) * scale;
+            }
+            out += Q4_GROUP_SIZE;
+        }
+        break;
+    }
+    case WEIGHT_Q8: {
+        const BlockQ8 *b = (const BlockQ8 *)w->data + offset / Q8_GROUP_SIZE;
+        for (int g = 0; g < n / Q8_GROUP_SIZE; g++, b++) {
+            float scale = f16_to_f32(b->scale);
+            for (int k = 0; k < Q8_GROUP_SIZE; k++) {
+                out[k] = b->qs[k] * scale;
+            }
+            out += Q8_GROUP_SIZE;
+        }
+        break;
+    }
+    case WEIGHT_S8: {
+        const BlockS8 *b = (const BlockS8 *)w->data + offset / S8_GROUP_SIZE;
+        for (int g = 0; g < n / S8_GROUP_SIZE; g++, b++) {
+            float scale = f16_to_f32(b->scale);
+            memset(out, 0, S8_GROUP_SIZE * sizeof(float));
+            for (int j = 0; j < S8_GROUP_SIZE / 2; j++) {
+                int k = (b->idx[j / 4] >> (2 * (j % 4))) & 3;
+                out[4 * (j / 2) + k] = b->qs[j] * scale;
+            }
+            out += S8_GROUP_SIZE;
+        }
+        break;
+    }
+    case WEIGHT_F32:
+    default:
+        memcpy(out, (const float *)w->data + offset, n * sizeof(float));
+        break;
+    }
+}
+
+/* ---- Fixed-point (DSP extension) kernels ---- */
+
+/*
+ * int16 activations, two per word, in the lane order the weight unpacking
+ * produces: SXTB16 on int8 weights yields elements (0,2) then (1,3) of
+ * each word; UXTB16 on the split nibbles of a Q4 word yields (0,4),
+ * (2,6), (1,5), (3,7).
+ */
+static uint32_t xq_words[MAX_MATMUL_N / 2];
+static int32_t xq_group_sum[MAX_MATMUL_N / Q4_GROUP_SIZE];
+
+static uint32_t pack16(int32_t lo, int32_t hi) {
+    return (uint32_t)(uint16_t)lo | ((uint32_t)(uint16_t)hi << 16);
+}
+
+/* Quantise x to int16 with one scale; returns that scale */
+static float quantize_activations(const float *x, int n, WeightType type) {
+    float amax = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float a = fabsf(x[i]);
+        if (a > amax) amax = a;
+    }
+    float scale = amax / 32767.0f;
+    float inv = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+    int32_t q[8];
+    for (int i = 0; i < n; i += 8) {
+        for (int k = 0; k < 8; k++) q[k] = (int32_t)lrintf(x[i + k] * inv);
+        uint32_t *out = xq_words + i / 2;
+        if (type == WEIGHT_Q4) {
+            out[0] = pack16(q[0], q[4]);
+            out[1] = pack16(q[2], q[6]);
+            out[2] = pack16(q[1], q[5]);
+            out[3] = pack16(q[3], q[7]);
+        } else {
+            out[0] = pack16(q[0], q[2]);
+            out[1] = pack16(q[1], q[3]);
+            out[2] = pack16(q[4], q[6]);
+            out[3] = pack16(q[5], q[7]);
+        }
+        if (i % Q4_GROUP_SIZE == 0) xq_group_sum[i / Q4_GROUP_SIZE] = 0;
+        for (int k = 0; k < 8; k++) xq_group_sum[i / Q4_GROUP_SIZE] += q[k];
+    }
+    return scale;
+}
+
+static void matmul_q8_dsp(float *xout, const float *x, const BlockQ8 *w,
+                          int n, int d) {
+    int groups = n / Q8_GROUP_SIZE;
+    float xscale = quantize_activations(x, n, WEIGHT_Q8);
+    for (int i = 0; i < d; i++) {
+        const BlockQ8 *b = w + i * groups;
+        float val = 0.0f;
+        for (int g = 0; g < groups; g++, b++) {
+            const uint32_t *xg = xq_words + g * (Q8_GROUP_SIZE / 2);
+            int32_t acc = 0;
+            for (int k = 0; k < Q8_GROUP_SIZE / 4; k++) {
+                uint32_t wv;
+                memcpy(&wv, b->qs + 4 * k, sizeof(wv));
+                acc = dsp_smlad(dsp_sxtb16(wv), xg[2 * k], acc);
+                acc = dsp_smlad(dsp_sxtb16(dsp_ror(wv, 8)), xg[2 * k + 1], acc);
+            }
+            val += acc * f16_to_f32(b->scale);
+        }
+        xout[i] = val * xscale;
+    }
+}
+
+/* Nibbles are stored as q + 8, so 8 * sum(x) comes off each group */
+static void matmul_q4_dsp(float *xout, const float *x, const BlockQ4 *w,
+                          int n, int d) {
+    int groups = n / Q4_GROUP_SIZE;
+    float xscale = quantize_activations(x, n, WEIGHT_Q4);
+    for (int i = 0; i < d; i++) {
+        const BlockQ4 *b = w + i * groups;
+        float val = 0.0f;
+        for (int g = 0; g < groups; g++, b++) {
+            const uint32_t *xg = xq_words + g * (Q4_GROUP_SIZE / 2);
+            int32_t acc = 0;
+            for (int k = 0; k < Q4_GROUP_SIZE / 8; k++) {
+                uint32_t wv;
+                memcpy(&wv, b->qs + 4 * k, sizeof(wv));
+                uint32_t lo = wv & 0x0f0f0f0fu;
+                uint32_t hi = (wv >> 4) & 0x0f0f0f0fu;
+                acc = dsp_smlad(dsp_uxtb16(lo), xg[4 * k], acc);
+                acc = dsp_smlad(dsp_uxtb16(dsp_ror(lo, 8)), xg[4 * k + 1], acc);
+                acc = dsp_smlad(dsp_uxtb16(hi), xg[4 * k + 2], acc);
+                acc = dsp_smlad(dsp_uxtb16(dsp_ror(hi, 8)), xg[4 * k + 3], acc);
+            }
+            acc -= 8 * xq_group_sum[g];
+            val += acc * f16_to_f32(b->scale);
+        }
+        xout[i] = val * xscale;
+    }
+}
+
+void weight_matmul_path(float *xout, const float *x, const WeightTensor *w,
+                        size_t offset, int n, int d, int use_dsp) {
+    switch (w->type) {
+    case WEIGHT_F16:
+        kernels->matmul_f16(xout, x, (const uint16_t *)w->data + offset, n, d);
+        break;
+    case WEIGHT_BF16:
+        kernels->matmul_bf16(xout, x, (const uint16_t *)w->data + offset, n, d);
+        break;
+    case WEIGHT_Q4: {
+        const BlockQ4 *b = (const BlockQ4 *)w->data + offset / Q4_GROUP_SIZE;
+        if (use_dsp) {
+            matmul_q4_dsp(xout, x, b, n, d);
+        } else {
+            kernels->matmul_q4(xout, x, b, n, d);
+        }
+        break;
+    }
+    case WEIGHT_Q8: {
+        const BlockQ8 *b = (const BlockQ8 *)w->data + offset / Q8_GROUP_SIZE;
+        if (use_dsp) {
+            matmul_q8_dsp(xout, x, b, n, d);
+        } else {
+            kernels->matmul_q8(xout, x, b, n, d);
+        }
+        break;
+    }
+    case WEIGHT_S8:
+        kernels->matmul_s8(xout, x,
+                           (const BlockS8 *)w->data + offset / S8_GROUP_SIZE,
+                           n, d);
+        break;
+    case WEIGHT_F32:
+    default:
+        kernels->matmul_f32(xout, x, (const float *)w->data + offset, n, d);
+        break;
+    }
+}
+
+void weight_matmul(float *xout, const float *x, const WeightTensor *w,
+                   size_t offset, int n, int d) {
+    weight_matmul_path(xout, x, w, offset, n, d, USE_DSP_KERNELS);
+}
+
+void weight_matmul_batch(float *xout, const float *x, const WeightTensor *w,
+                         size_t offset, int n, int d, int n_batch,
+                         float *row) {
+    for (int i = 0; i < d; i++) {
+        const float *r = row;
+        if (w->type == WEIGHT_F32) {
+            r = (const float *)w->data + offset + (size_t)i * n;
+        } else {
+            weight_row(row, w, offset + (size_t)i * n, n);
+        }
+        /* One output per vector: the row is the "vector" and x the
+           "matrix", so the backend's fp32 kernel does the dot */
+        for (int b = 0; b < n_batch; b++) {
+            kernels->matmul_f32(xout + (size_t)b * d + i, r,
+                                x + (size_t)b * n, n, 1);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef WEIGHTS_H
+#define WEIGHTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Storage format of a weight matrix (values are stored in model files) */
+typedef enum {
+    WEIGHT_F32 = 0,
+    WEIGHT_F16,
+    WEIGHT_BF16,
+    WEIGHT_Q4,
+    WEIGHT_Q8,
+    WEIGHT_S8,
+    N_WEIGHT_TYPES
+} WeightType;
+
+/*
+ * WEIGHT_Q4: symmetric 4-bit groups with an fp16 scale, stored as
+ * interleaved blocks. Element 2k of a group is the low nibble of qs[k],
+ * element 2k+1 the high nibble; each nibble holds q + 8 for q in [-8, 7].
+ * Matrix rows must be a whole number of groups.
+ */
+#define Q4_GROUP_SIZE 32
+
+typedef struct {
+    uint16_t scale;                     /* fp16 */
+    uint8_t qs[Q4_GROUP_SIZE / 2];
+} BlockQ4;
+
+/* WEIGHT_Q8: symmetric int8 groups with an fp16 scale, as blocks */
+#define Q8_GROUP_SIZE 32
+
+typedef struct {
+    uint16_t scale;                     /* fp16 */
+    int8_t qs[Q8_GROUP_SIZE];
+} BlockQ8;
+
+/*
+ * WEIGHT_S8: 2:4 structured-sparse int8. Of every 4 consecutive elements
+ * only the 2 largest in magnitude are kept; a group stores its 16 kept
+ * values as int8 with an fp16 scale, plus each one's 2-bit position
+ * within its 4 (value j sits in run j / 2, position bits 2(j % 4) of
+ * idx[j / 4]). 22 bytes per 32 elements against Q8's 34. A group with
+ * scale 0 is all zeros (block-pruned by tools/quantize.c --prune): the
+ * kernels read its scale and skip the rest. Matrix rows must be a whole
+ * number of groups.
+ */
+#define S8_GROUP_SIZE 32
+
+typedef struct {
+    uint16_t scale;                     /* fp16; 0 for an all-zero group */
+    uint8_t idx[S8_GROUP_SIZE / 8];
+    int8_t qs[S8_GROUP_SIZE / 2];
+} BlockS8;
+
+/*
+ * Quantised matmuls can run in fixed point: activations are quantised to
+ * int16 once per call and dotted with the int8/int4 weights two MACs at
+ * a time with SMLAD (see dsp.h), one fp32 multiply per group. Otherwise
+ * weights are widened to fp32 for the FPU. On by default when the target
+ * has the DSP extension; the host emulation gives identical results.
+ */
+#ifndef USE_DSP_KERNELS
+#if defined(__ARM_FEATURE_DSP)
+#define USE_DSP_KERNELS 1
+#else
+#define USE_DSP_KERNELS 0
+#endif
+#endif
+
+/*
+ * A weight matrix, stacked across layers. Kernels take an element offset
+ * into it so per-layer slices don't need their own pointers; for grouped
+ * formats the offset must fall on a group boundary.
+ */
+typedef struct {
+    void *data;
+    WeightType type;
+} WeightTensor;
+
+/* Quantisation error accumulated by weight_convert() */
+typedef struct {
+    float max_abs;
+    double sum_sq_err;
+    double sum_sq_ref;
+} WeightError;
+
+/** Short name of a weight type for log output ("f32", "f16", ...). */
+const char *weight_type_name(WeightType type);
+
+/** Bytes needed to store n elements in the given format. */
+size_t weight_bytes(WeightType type, size_t n);
+
+/** Nonzero if rows of row_len elements can be stored in the given format. */
+int weight_row_ok(WeightType type, int row_len);
+
+/**
+ * Store n fp32 values at dst in the given format. dst may alias src as
+ * long as it does not start after it, so tensors can be compacted in place.
+ * err (optional) accumulates the rounding error. Returns bytes written.
+ */
+size_t weight_convert(void *dst, const float *src, size_t n, WeightType type,
+                      WeightError *err);
+
+/** Widen n elements starting at element offset into fp32. */
+void weight_row(float *out, const WeightTensor *w, size_t offset, int n);
+
+/**
+ * xout[d] = W[d][n] @ x[n], where W starts at element offset in w.
+ * Weights are widened to fp32 in registers; accumulation is fp32. Runs on
+ * the active kernels backend (kernels.h) unless the DSP path applies.
+ */
+void weight_matmul(float *xout, const float *x, const WeightTensor *w,
+                   size_t offset, int n, int d);
+
+/**
+ * Batched weight_matmul(): xout[b][d] = W[d][n] @ x[b][n] for n_batch
+ * row-major vectors. Each weight row is read from PSRAM and widened once
+ * for the whole batch, so weight traffic doesn't grow with n_batch. row
+ * is scratch for one widened row (n floats).
+ */
+void weight_matmul_batch(float *xout, const float *x, const WeightTensor *w,
+                         size_t offset, int n, int d, int n_batch,
+                         float *row);
+
+/**
+ * weight_matmul() with the fixed-point path for quantised weights forced
+ * on or off, for benchmarking one against the other.
+ */
+void weight_matmul_path(float *xout, const float *x, const WeightTensor *w,
+                        size_t offset, int n, int d, int use_dsp);
+
+#endif /* WEIGHTS_H */